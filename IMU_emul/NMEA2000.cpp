@@ -25,27 +25,43 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <fcntl.h>
-#include <errno.h>
 #include <err.h>
-
-#include <sys/ioctl.h>
-#include <sys/select.h>
-#include <sys/time.h>
-#include <net/if.h>
+#include <errno.h>
 
 #include <iostream>
 #include "NMEA2000.h"
+#include "nmea2000_evloop.h"
 #include "nmea2000_defs_tx.h"
 #include "nmea2000_defs_rx.h"
 
 nmea2000 *nmea2000P;
 
+/* a device alone on its own bus */
 nmea2000::nmea2000(const char *ifname) {
-    canif = ifname;
-    thread_running = 0;
+    bus = new nmea2000_bus(ifname);
+    ownbus = true;
+    init_node();
+}
+
+/* a device sharing bus with others */
+nmea2000::nmea2000(nmea2000_bus *b) {
+    bus = b;
+    ownbus = false;
+    init_node();
+}
+
+void nmea2000::init_node() {
+    static bool seeded;
+
+    if (!seeded) {
+	srandom(time(NULL));
+	seeded = true;
+    }
+    state = UNCONF;
+    claim_defend = false;
+    claim_cb = NULL;
+    claim_arg = NULL;
     myaddress = 0x80;
-    srandom(time(NULL));
     // the following may be overriden by the config file
     uniquenumber = random() & 0x1fffff;
     deviceinstance = 0;
@@ -57,138 +73,150 @@ nmea2000::nmea2000(const char *ifname) {
 
 nmea2000::~nmea2000(void)
 {
-    while (thread_running) {
-	thread_running = 0;
-	pthread_join(thread, NULL);
-    }
-    close(sock);
+    bus->detach(this);
+    if (ownbus)
+	delete bus;
     delete nmea2000_rxP;
     delete nmea2000_txP;
 }
 
-void nmea2000::Init() {
+/*
+ * with a loop, the stack runs from the caller's event loop and no thread
+ * is created; otherwise threads handle the bus. For a shared bus, the
+ * loop is given to nmea2000_bus::Init() instead.
+ */
+void nmea2000::Init(nmea2000_evloop *loop) {
 
     state = UNCONF;
-
-    if ((sock = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
-	err(1, "create CAN socket");
-	return;
-    }
     nmea2000_txP->setsrc(myaddress);
     nmea2000_txP->iso_address_claim.setdst(NMEA2000_ADDR_GLOBAL);
     nmea2000_txP->iso_address_claim.setdata(uniquenumber, manufcode, 140, 60, deviceinstance, 0);
     nmea2000_txP->iso_address_claim.enabled = 1;
-    nmea2000_txP->iso_address_claim.valid = 1;
-    if (pthread_create(&thread, NULL, nmea2000::rx_thread, this)) {
-        err(1, "can't create rx thread");
-	return;
-    }
+    nmea2000_txP->iso_address_claim.updated();
+    bus->attach(this);
+    if (ownbus)
+	bus->Init(loop);
 }
 
-void *
-nmea2000::rx_thread(void *p)
+/*
+ * one step of the address claim state machine, run by the bus once it's
+ * configured. Returns true if it wants to run again at next.
+ */
+bool nmea2000::claim_step(const struct timespec *now, struct timespec *next)
 {
-    nmea2000 *n2kp = (nmea2000 *)p;
-
-    n2kp->thread_running = 1;
-    while (n2kp->thread_running) {
-	switch(n2kp->state) {
+	if (claim_defend) {
+		claim_defend = false;
+		// defend our address. if we can't right now restart the whole process
+		if (state != DOCLAIM && !send_address_claim()) {
+			if (state == CLAIMED)
+				claim_notify(false);
+			state = DOCLAIM;
+		}
+	}
+	switch(state) {
 	case UNCONF:
-	case DOINGCONF:
-	        if (n2kp->configure()) {
-	            n2kp->state = DOCLAIM;
-	        } else {
-	            n2kp->state = DOINGCONF;
-		    sleep(1);
-	        }
-	        break;
 	case DOCLAIM:
-		if (n2kp->nmea2000_txP->iso_address_claim.send(n2kp->sock)) {
-			n2kp->state = CLAIMING;
-			gettimeofday(&n2kp->claim_date, NULL);
+		claim_deadline = *now;
+		nmea2000_evloop::addms(&claim_deadline, NMEA2000_CLAIM_WINDOW);
+		if (send_address_claim()) {
+			state = CLAIMING;
 		} else {
 			std::cerr << "failed to send claim " << std::endl;
-			sleep(1);
+			state = DOCLAIM;
 		}
-		break;
+		*next = claim_deadline;
+		return true;
 	case CLAIMING:
-		struct timeval tv;
-		struct timeval tv2;
-		// poll checking for addr claim, and timeout
-		gettimeofday(&tv, NULL);
-		timersub(&tv, &n2kp->claim_date, &tv2);
-		if (tv2.tv_sec >= 1) {
-			std::cout << "NMEA200 address " << n2kp->myaddress << std::endl;
-			n2kp->state = CLAIMED;
+		if (timespeccmp(&claim_deadline, now, <=)) {
+			std::cout << "NMEA200 address " << myaddress << std::endl;
+			state = CLAIMED;
+			claim_notify(true);
+			return false;
 		}
-		/* FALLTHROUGH */
-	case CLAIMED:
-		// normal operation
-		struct timeval timeout;
-		fd_set read_set;
-		int sret;
-
-		timeout.tv_sec=1;
-		timeout.tv_usec = 0;
-
-		FD_ZERO(&read_set);
-		FD_SET(n2kp->sock, &read_set);
-		sret = select(n2kp->sock + 1, &read_set, NULL, NULL, &timeout);
-		switch(sret) {
-		case -1:
-			warn("select");
-			break;
-		case 0:
-			break;
-		default:
-			nmea2000_frame n2kframe;
-			int rret = n2kframe.readframe(n2kp->sock);
-			switch(rret) {
-			case -1:
-				warn("read CAN socket");
-				break;
-			case 0:
-				/* EOF ? */
-				break;
-			default:
-				n2kp->parse_frame(n2kframe);
-				break;
-			}
-		}
-		break;
+		*next = claim_deadline;
+		return true;
 	default:
-		sleep(1);
+		return false;
 	}
-    }
-    n2kp->thread_running = 0;
-    return 0;
 }
 
-bool nmea2000::configure()
+/*
+ * wake up wait_claimed() and tell the callback. Called from the bus
+ * context, with the bus mutex held in threaded mode.
+ */
+void nmea2000::claim_notify(bool claimed)
 {
-    struct ifreq ifr;
-    struct sockaddr_can addr;
-
-    memset(&ifr, 0, sizeof(ifr));
-    if (canif != NULL) {
-	strcpy(ifr.ifr_name, canif);
-	if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
-	    if (state == UNCONF) {
-		std::cerr << "can't get index for CAN interface " << canif << std::endl;
-	    }
-	    return false;
-        }
-        addr.can_family = AF_CAN;
-        addr.can_ifindex = ifr.ifr_ifindex;
-        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-	    if (state == UNCONF) {
-	        warn("can't bind CAN socket to %s", canif);
-	    }
-	    return false;
-        }
-        return true;
-    }
-    return false;
+	pthread_cond_broadcast(&bus->state_cv);
+	if (claim_cb != NULL)
+		(*claim_cb)(this, claimed, claim_arg);
+}
+
+/*
+ * wait up to ms milliseconds (forever if < 0) for our address claim to
+ * complete. Only for threaded mode: with an event loop, use the callback.
+ */
+bool nmea2000::wait_claimed(int ms)
+{
+	return bus->wait_state(this, ms);
+}
+
+void nmea2000::set_claim_cb(nmea2000_claim_cb cb, void *arg)
+{
+	pthread_mutex_lock(&bus->mtx);
+	claim_cb = cb;
+	claim_arg = arg;
+	pthread_mutex_unlock(&bus->mtx);
+}
+
+/* send our claim, and show it to the other devices on our socket */
+bool nmea2000::send_address_claim()
+{
+	if (!nmea2000_txP->iso_address_claim.send(bus->getsock())) {
+		bus->stats.tx_error(nmea2000_txP->iso_address_claim.getframe(),
+		    errno);
+		return false;
+	}
+	bus->stats.tx(nmea2000_txP->iso_address_claim.getframe());
+	bus->stats.claims_sent++;
+	bus->claim_loopback(this, nmea2000_txP->iso_address_claim);
+	return true;
+}
+
+/*
+ * transmit pgn every interval ms, calling cb just before to update it.
+ * The schedule is run by the bus, from the event loop or from its thread.
+ */
+bool nmea2000::set_periodic(int pgn, int interval, nmea2000_update_cb cb, void *arg)
+{
+	int i = nmea2000_txP->get_bypgn(pgn);
+	struct timespec now;
+
+	if (i < 0)
+		return false;
+	pthread_mutex_lock(&bus->mtx);
+	nmea2000_txP->set_periodic(i, interval, cb, arg);
+	nmea2000_evloop::now(&now);
+	nmea2000_txP->sched_start(&now);
+	pthread_mutex_unlock(&bus->mtx);
+	bus->sched_changed();
+	return true;
+}
+
+void nmea2000::print_tx_stats(std::ostream &os)
+{
+	nmea2000_txP->print_sched_stats(os);
+	bus->txq.print_stats(os);
+}
+
+void nmea2000::set_rx_batch(int n)
+{
+	bus->set_rx_batch(n);
+}
+
+void nmea2000::print_rx_stats(std::ostream &os)
+{
+	bus->print_rx_stats(os);
+	nmea2000_rxP->print_stats(os);
 }
 
 void nmea2000::parse_frame(const nmea2000_frame &n2kf)
@@ -214,24 +242,29 @@ void nmea2000::parse_frame(const nmea2000_frame &n2kf)
 
 void nmea2000::handle_address_claim(const nmea2000_frame &n2kf)
 {
-	if (n2kf.getsrc() != myaddress)
+	if (n2kf.getsrc() != myaddress || state == UNCONF)
 		return;
 	for (int i = 7; i >= 0; i--) {
 	    if (n2kf.getdata()[i] < nmea2000_txP->iso_address_claim.getdata()[i]) {
 		// we loose
+		bus->stats.claims_lost++;
 		myaddress++;
 		if (myaddress >= NMEA2000_ADDR_MAX)
 			myaddress = 0;
 		nmea2000_txP->setsrc(myaddress);
+		bus->addr_changed();
+		if (state == CLAIMED)
+			claim_notify(false);
 		state = DOCLAIM;
+		bus->claim_changed();
 		return;
 	    }
 	    if (n2kf.getdata()[i] > nmea2000_txP->iso_address_claim.getdata()[i])
 		break;
 	}
-	// defend our address. if we can't right now restart the whole process
-	if (!nmea2000_txP->iso_address_claim.send(sock)) 
-		state = DOCLAIM;
+	claim_defend = true;
+	bus->stats.claims_defended++;
+	bus->claim_changed();
 }
 
 void nmea2000::handle_iso_request(const nmea2000_frame &n2kf)
@@ -244,7 +277,7 @@ void nmea2000::handle_iso_request(const nmea2000_frame &n2kf)
 	if (nmea2000_txP->get_bypgn(pgn) < 0) {
 		return;
 	}
-	nmea2000_txP->send_frame(sock, pgn);
+	nmea2000_txP->send_frame(bus->getsock(), pgn);
 }
 
 const nmea2000_desc *nmea2000::get_tx_byindex(int i) {
@@ -260,10 +293,20 @@ nmea2000_frame_tx *nmea2000::get_frametx(int i) {
 }
 
 bool nmea2000::send_bypgn(int pgn, bool force) {
+	return send_bypgn(&pgn, 1, force);
+}
+
+/* send several PGNs (e.g. all those due in the same tick) in one batch */
+bool nmea2000::send_bypgn(const int *pgns, int npgns, bool force) {
+	bool ret;
+
 	if (state != CLAIMED)
 		return false;
 
-	return nmea2000_txP->send_frame(sock, pgn, force);
+	pthread_mutex_lock(&bus->mtx);
+	ret = nmea2000_txP->send_frames(bus->getsock(), pgns, npgns, force);
+	pthread_mutex_unlock(&bus->mtx);
+	return ret;
 }
 
 void nmea2000::tx_enable(int i, bool en) {
@@ -274,10 +317,15 @@ const nmea2000_desc *nmea2000::get_rx_byindex(int i) {
 	return nmea2000_rxP->get_byindex(i);
 }
 
+nmea2000_frame_rx *nmea2000::get_framerx(int i) {
+	return nmea2000_rxP->get_framerx(i);
+}
+
 int nmea2000::get_rx_bypgn(int pgn) {
 	return nmea2000_rxP->get_bypgn(pgn);
 }
 
 void nmea2000::rx_enable(int i, bool en) {
 	nmea2000_rxP->enable(i, en);
+	bus->update_filter();
 }
@@ -29,23 +29,140 @@
 #define NMEA2000_H_
 
 #include <pthread.h>
+#include <sys/uio.h>
+#include <vector>
+#include <ostream>
 #include "nmea2000_defs.h"
+#include "nmea2000_frame.h"
+#include "nmea2000_defs_tx.h"
+#include "nmea2000_tstamp.h"
+#include "nmea2000_stats.h"
+#include "nmea2000_txqueue.h"
 
 class nmea2000_frame;
 class nmea2000_rx;
 class nmea2000_tx;
 class nmea2000_frame_tx;
+class nmea2000_frame_rx;
+class nmea2000_evloop;
+class nmea2000;
 
+#define NMEA2000_RX_BATCH 32	/* max frames drained per wakeup */
+#define NMEA2000_CLAIM_WINDOW 250 /* ms to wait for a contending claim */
+#define NMEA2000_CONF_RETRY_MIN 10	/* ms, first interface bind retry */
+#define NMEA2000_CONF_RETRY_MAX 1000	/* ms, backoff limit */
+
+/* called from the bus context when a device gets (or loses) an address */
+typedef void (*nmea2000_claim_cb)(nmea2000 *, bool, void *);
+
+/*
+ * a CAN interface, shared by one or more nmea2000 devices: one socket,
+ * one receive loop demultiplexing frames by destination address, and
+ * one periodic transmit scheduler for all the devices.
+ */
+class nmea2000_bus {
+   public:
+    nmea2000_bus(const char *);
+    ~nmea2000_bus(void);
+
+    void Init(nmea2000_evloop *loop = NULL);
+
+    inline void setcanif(const char *ifn) {canif = ifn;}
+    inline const char *getcanif() {return canif;}
+    inline int getsock() {return sock;}
+    inline bool isconfigured() {return configured;}
+    bool wait_configured(int ms = -1);
+
+    void attach(nmea2000 *);
+    void detach(nmea2000 *);
+    void update_filter();
+    void set_rx_batch(int);
+    void print_rx_stats(std::ostream &);
+    bool add_latency(int req_pgn, int resp_pgn);
+    void print_latency(std::ostream &, bool buckets = false);
+    bool start_stats(const char *spec);
+    void print_metrics(std::ostream &);
+
+  private:
+    friend class nmea2000;
+
+    const char *canif;
+    int sock;
+    volatile bool configured;
+    std::vector<nmea2000 *> nodes;
+    nmea2000 *byaddr[NMEA2000_ADDR_GLOBAL + 1];
+    bool byaddr_valid;
+    pthread_mutex_t mtx;
+    volatile bool thread_running;
+    pthread_t thread;
+    int wakeup[2];
+    volatile bool sched_running;
+    pthread_t sched_thr;
+    pthread_cond_t sched_cv;
+    pthread_cond_t state_cv;
+    int conf_retry;
+    nmea2000_evloop *evloop;
+    int claim_timer;
+    int sched_timer;
+    int rx_batch;
+    struct can_frame rx_frames[NMEA2000_RX_BATCH];
+    struct iovec rx_iov[NMEA2000_RX_BATCH];
+    struct mmsghdr rx_msgs[NMEA2000_RX_BATCH];
+    char rx_cmsg[NMEA2000_RX_BATCH][NMEA2000_CMSG_SIZE];
+    bool tstamp_on;
+    bool tx_tstamp;	/* tx timestamps requested from the kernel */
+    nmea2000_latency latency;
+    nmea2000_stats stats;
+    nmea2000_stats_server *stats_srv;
+    bool rxq_ovfl;	/* SO_RXQ_OVFL enabled */
+    nmea2000_txqueue txq;
+    int tx_timer;
+    bool tx_pollout;	/* threaded mode: txq waits for POLLOUT */
+    bool tx_retry_set;	/* or until tx_retry */
+    struct timespec tx_retry;
+    unsigned long rx_batch_hist[NMEA2000_RX_BATCH + 1];
+
+    bool configure();
+    bool try_configure(int *retry);
+    bool wait_state(nmea2000 *, int ms);
+    void receive();
+    void receive_txstamps();
+    void tstamp_enable();
+    void dispatch(const nmea2000_frame &);
+    bool claim_run(struct timespec *next);
+    bool sched_run(struct timespec *next);
+    void claim_changed();
+    void sched_changed();
+    void claim_loopback(nmea2000 *, const nmea2000_frame &);
+    inline void addr_changed() { byaddr_valid = false; }
+    nmea2000 *node_byaddr(int);
+    static void add_filter(std::vector<struct can_filter> &, int);
+    static void * rx_thread(void *p);
+    static void * sched_thread(void *p);
+    static void ev_read(int, void *);
+    static void ev_claim(int, void *);
+    static void ev_sched(int, void *);
+    static void metrics_cb(std::ostream &, void *);
+    static void tx_sent(const struct can_frame *, void *);
+    static void tx_blocked(bool, const struct timespec *, void *);
+    static void ev_write(int, void *);
+    static void ev_txretry(int, void *);
+};
+
+/* a NMEA2000 device: NAME, address claim, and its rx and tx PGN sets */
 class nmea2000 {
    public:
     nmea2000(const char *);
+    nmea2000(nmea2000_bus *);
     ~nmea2000(void);
 
-    void Init(void);
+    void Init(nmea2000_evloop *loop = NULL);
 
-    inline void setcanif(const char *ifn) {canif = ifn;}
-    inline const char *getcanif() {return canif;}
+    inline void setcanif(const char *ifn) {bus->setcanif(ifn);}
+    inline const char *getcanif() {return bus->getcanif();}
+    inline nmea2000_bus *getbus() {return bus;}
     int getaddress(void) { return myaddress; }
+    inline void setaddress(int a) { myaddress = a; }
     inline void getconfig(int *un, int * di, int *mf)
 	{ *un = uniquenumber; *di = deviceinstance; *mf = manufcode; }
     inline void setconfig(int un, int di, int mf)
@@ -54,33 +171,47 @@ class nmea2000 {
     int get_tx_bypgn(int);
     nmea2000_frame_tx *get_frametx(int i);
     bool send_bypgn(int pgn, bool force = false);
+    bool send_bypgn(const int *pgns, int npgns, bool force = false);
+    bool set_periodic(int pgn, int interval, nmea2000_update_cb, void *);
+    inline bool isclaimed() { return state == CLAIMED; }
+    bool wait_claimed(int ms = -1);
+    void set_claim_cb(nmea2000_claim_cb, void *);
 
     void tx_enable(int, bool);
     const nmea2000_desc *get_rx_byindex(int);
+    nmea2000_frame_rx *get_framerx(int i);
     int get_rx_bypgn(int);
     void rx_enable(int, bool);
-    static void * rx_thread(void *p);
+
+    void set_rx_batch(int);
+    void print_rx_stats(std::ostream &);
+    void print_tx_stats(std::ostream &);
 
   private:
-    volatile bool thread_running;
-    pthread_t thread;
+    friend class nmea2000_bus;
+
+    nmea2000_bus *bus;
+    bool ownbus;
     int myaddress;
-    const char *canif;
     int deviceinstance;
     int uniquenumber;
     int manufcode;
     nmea2000_rx *nmea2000_rxP;
     nmea2000_tx *nmea2000_txP;
-    int sock;
     enum {
-	UNCONF, DOINGCONF, DOCLAIM, CLAIMING, CLAIMED
-    } state;
-    struct timeval claim_date;
-    bool configure();
+	UNCONF, DOCLAIM, CLAIMING, CLAIMED
+    } volatile state;
+    struct timespec claim_deadline;
+    bool claim_defend;
+    nmea2000_claim_cb claim_cb;
+    void *claim_arg;
+    void claim_notify(bool);
+    void init_node();
+    bool claim_step(const struct timespec *now, struct timespec *next);
+    bool send_address_claim();
     void parse_frame(const nmea2000_frame &);
     void handle_address_claim(const nmea2000_frame &);
     void handle_iso_request(const nmea2000_frame &);
-    bool send_address_claim();
 };
 
 extern nmea2000 *nmea2000P;
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * tests for the PGN layouts of nmea2000_fields.h: every field of every
+ * layout is checked against a bit by bit reference encoder (byte layout,
+ * neighbouring bits untouched, sign extension, not available value,
+ * clamping), and each layout against a hand-encoded frame.
+ * Exits with status 1 if anything is wrong.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <err.h>
+
+#include "nmea2000_fields.h"
+
+static int nfail;
+
+#define CHECK(c, ...) do {						\
+	if (!(c)) {							\
+		warnx(__VA_ARGS__);					\
+		nfail++;						\
+	}								\
+} while (0)
+
+/* reference: set bits [off, off + bits) of d from v, one at a time */
+static void
+ref_put(uint8_t *d, int off, int bits, uint32_t v)
+{
+	for (int i = 0; i < bits; i++) {
+		int b = off + i;
+
+		if (v & (1U << i))
+			d[b / 8] |= 1 << (b % 8);
+		else
+			d[b / 8] &= ~(1 << (b % 8));
+	}
+}
+
+/* put_raw(v) in a buffer filled with pattern, compare with ref_put() */
+template <class F> static void
+check_raw(const char *name, uint8_t pattern, typename F::raw_t v)
+{
+	uint8_t d[223], ref[223];
+
+	memset(d, pattern, sizeof(d));
+	memset(ref, pattern, sizeof(ref));
+	F::put_raw(d, v);
+	ref_put(ref, F::off, F::bits, (uint32_t)v);
+	CHECK(memcmp(d, ref, sizeof(d)) == 0,
+	    "%s: put_raw(%ld) on 0x%02x: wrong bits", name, (long)v, pattern);
+	CHECK(F::get_raw(d) == v, "%s: get_raw() %ld != %ld",
+	    name, (long)F::get_raw(d), (long)v);
+}
+
+template <class F> static void
+check_field(const char *name, int idx)
+{
+	typedef typename F::raw_t raw_t;
+	const raw_t vals[] = { 0, 1, 2, (raw_t)F::raw_min(),
+	    (raw_t)F::raw_max(), F::na(), (raw_t)(F::mask() >> 2),
+	    (raw_t)(0x5a5a5a5aU & (F::mask() >> 1)) };
+	uint8_t d[223];
+	char fname[64];
+
+	snprintf(fname, sizeof(fname), "%s field %d", name, idx);
+	for (size_t i = 0; i < sizeof(vals) / sizeof(vals[0]); i++) {
+		/* small fields */
+		if (vals[i] < F::raw_min() || vals[i] > F::na())
+			continue;
+		check_raw<F>(fname, 0x00, vals[i]);
+		check_raw<F>(fname, 0xff, vals[i]);
+		check_raw<F>(fname, 0xa5, vals[i]);
+	}
+	/* reserved bits are checked with the frames */
+	if (F::reserved)
+		return;
+
+	/* sign extension */
+	if (std::is_signed<raw_t>::value) {
+		memset(d, 0, sizeof(d));
+		ref_put(d, F::off, F::bits, F::mask());
+		CHECK(F::get_raw(d) == -1, "%s: -1 not sign extended", fname);
+		CHECK(F::get(d) < 0, "%s: get(-1) not negative", fname);
+		memset(d, 0xff, sizeof(d));
+		ref_put(d, F::off, F::bits, 1);
+		CHECK(F::get_raw(d) == 1, "%s: 1 sign extended", fname);
+	}
+
+	/* user units round trip, within a resolution step */
+	for (size_t i = 0; i < sizeof(vals) / sizeof(vals[0]); i++) {
+		double v;
+
+		if (vals[i] < F::raw_min() || vals[i] >= F::na())
+			continue;
+		v = vals[i] / F::scale();
+		memset(d, 0, sizeof(d));
+		F::put(d, v);
+		CHECK(fabs(F::get(d) - v) <= 1 / F::scale(),
+		    "%s: put(%g) get() %g", fname, v, F::get(d));
+		CHECK(F::available(d), "%s: put(%g) not available", fname, v);
+	}
+
+	/* not available */
+	memset(d, 0, sizeof(d));
+	F::put(d, NAN);
+	CHECK(!F::available(d), "%s: put(NAN) available", fname);
+	CHECK(F::get_raw(d) == F::na(), "%s: put(NAN) raw %ld", fname,
+	    (long)F::get_raw(d));
+
+	/* clamping, never to the not available value */
+	F::put(d, 1e30);
+	CHECK(F::get_raw(d) == (raw_t)F::raw_max(), "%s: put(1e30) raw %ld",
+	    fname, (long)F::get_raw(d));
+	CHECK(F::available(d), "%s: put(1e30) not available", fname);
+	F::put(d, -1e30);
+	CHECK(F::get_raw(d) == (raw_t)F::raw_min(), "%s: put(-1e30) raw %ld",
+	    fname, (long)F::get_raw(d));
+	F::put(d, INFINITY);
+	CHECK(F::get_raw(d) == (raw_t)F::raw_max(), "%s: put(inf) raw %ld",
+	    fname, (long)F::get_raw(d));
+}
+
+template <int LEN, class... FS> static void
+check_layout(const char *name, n2k_layout<LEN, FS...> *)
+{
+	int idx = 0;
+	int dummy[] = { 0, (check_field<FS>(name, idx++), 0)... };
+	(void)dummy;
+}
+
+/* compare a frame with the expected bytes */
+static void
+check_frame(const char *name, const uint8_t *d, const uint8_t *exp, int len)
+{
+	for (int i = 0; i < len; i++) {
+		CHECK(d[i] == exp[i], "%s: byte %d 0x%02x, expected 0x%02x",
+		    name, i, d[i], exp[i]);
+	}
+}
+
+#define FIELD_GET(P, f, v) \
+	CHECK(P::f::get(d) == (v), #P "::" #f ": get() %g, expected %g", \
+	    (double)P::f::get(d), (double)(v))
+
+static void
+check_address_claim(void)
+{
+	typedef iso_address_claim_pgn P;
+	static const uint8_t exp[] =
+	    { 0x45, 0x23, 0x61, 0x22, 0x03, 0x8c, 0x50, 0xc2 };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0xff, sizeof(d));
+	P::layout::init(d);
+	P::uniquenumber::put_raw(d, 0x12345);
+	P::manufcode::put_raw(d, 275);
+	P::deviceinstance::put_raw(d, 3);
+	P::devicefunction::put_raw(d, 140);
+	P::deviceclass::put_raw(d, 40);
+	P::systeminstance::put_raw(d, 2);
+	P::industrygroup::put_raw(d, 4);
+	P::selfconfigurable::put_raw(d, 1);
+	check_frame("iso_address_claim", d, exp, sizeof(d));
+	FIELD_GET(P, manufcode, 275);
+	FIELD_GET(P, deviceclass, 40);
+}
+
+static void
+check_attitude(void)
+{
+	typedef n2k_attitude_pgn P;
+	static const uint8_t exp[] =
+	    { 0x05, 0x10, 0x27, 0x78, 0xec, 0xff, 0x7f, 0xff };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::sid::put_raw(d, 5);
+	P::yaw::put(d, 1.0);
+	P::pitch::put(d, -0.5);
+	P::roll::put(d, NAN);
+	check_frame("attitude", d, exp, sizeof(d));
+	FIELD_GET(P, yaw, 1.0);
+	FIELD_GET(P, pitch, -0.5);
+	CHECK(!P::roll::available(d), "attitude: roll available");
+}
+
+static void
+check_rateofturn(void)
+{
+	typedef n2k_rateofturn_pgn P;
+	static const uint8_t exp[] =
+	    { 0x01, 0x60, 0xda, 0xd9, 0xff, 0xff, 0xff, 0xff };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::sid::put_raw(d, 1);
+	P::rate::put(d, -0.25);
+	check_frame("rateofturn", d, exp, sizeof(d));
+	FIELD_GET(P, rate, -0.25);
+}
+
+static void
+check_rudder(void)
+{
+	typedef n2k_rudder_pgn P;
+	static const uint8_t exp[] =
+	    { 0x00, 0xfa, 0x1e, 0xfb, 0xc4, 0x09, 0xff, 0xff };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::instance::put_raw(d, 0);
+	P::direction::put_raw(d, 2);
+	P::angle_order::put(d, -0.125);
+	P::position::put(d, 0.25);
+	check_frame("rudder", d, exp, sizeof(d));
+	FIELD_GET(P, direction, 2);
+	FIELD_GET(P, angle_order, -0.125);
+	FIELD_GET(P, position, 0.25);
+}
+
+static void
+check_heading(void)
+{
+	typedef n2k_heading_pgn P;
+	static const uint8_t exp[] =
+	    { 0x00, 0x30, 0x75, 0xff, 0x7f, 0x8f, 0xfd, 0xfd };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::sid::put_raw(d, 0);
+	P::heading::put(d, 3.0);
+	P::deviation::put(d, NAN);
+	P::variation::put(d, -0.0625);
+	P::reference::put_raw(d, 1);
+	check_frame("heading", d, exp, sizeof(d));
+	FIELD_GET(P, heading, 3.0);
+	FIELD_GET(P, variation, -0.0625);
+	CHECK(!P::deviation::available(d), "heading: deviation available");
+}
+
+static void
+check_position_rapid(void)
+{
+	typedef n2k_position_rapid_pgn P;
+	static const uint8_t exp[] =
+	    { 0xc0, 0xec, 0x4f, 0x1c, 0xe0, 0x16, 0x10, 0xfe };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::latitude::put(d, 47.5);
+	P::longitude::put(d, -3.25);
+	check_frame("position_rapid", d, exp, sizeof(d));
+	FIELD_GET(P, latitude, 47.5);
+	FIELD_GET(P, longitude, -3.25);
+}
+
+static void
+check_cogsog(void)
+{
+	typedef n2k_cogsog_pgn P;
+	static const uint8_t exp[] =
+	    { 0xfe, 0xfc, 0x98, 0x3a, 0xfa, 0x00, 0xff, 0xff };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::sid::put_raw(d, 0xfe);
+	P::reference::put_raw(d, 0);
+	P::cog::put(d, 1.5);
+	P::sog::put(d, 2.5);
+	check_frame("cogsog", d, exp, sizeof(d));
+	FIELD_GET(P, cog, 1.5);
+	FIELD_GET(P, sog, 2.5);
+}
+
+static void
+check_xte(void)
+{
+	typedef n2k_xte_pgn P;
+	static const uint8_t exp[] =
+	    { 0x07, 0x72, 0x1e, 0xfb, 0xff, 0xff, 0xff, 0xff };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::sid::put_raw(d, 7);
+	P::mode::put_raw(d, 2);
+	P::navterminated::put_raw(d, 1);
+	P::xte::put(d, -12.5);
+	check_frame("xte", d, exp, sizeof(d));
+	FIELD_GET(P, xte, -12.5);
+}
+
+static void
+check_navdata(void)
+{
+	typedef n2k_navdata_pgn P;
+	static const uint8_t exp[] = {
+	    0x09, 0xa2, 0xd3, 0x02, 0x00, 0x11, 0x88, 0xdf,
+	    0xbf, 0x19, 0x20, 0x4e, 0x88, 0x13, 0x4c, 0x1d,
+	    0x01, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00,
+	    0xd0, 0x15, 0xcf, 0xeb, 0x20, 0xeb, 0x26, 0x5a,
+	    0x6a, 0xff };
+	uint8_t d[P::layout::len];
+
+	memset(d, 0, sizeof(d));
+	P::layout::init(d);
+	P::sid::put_raw(d, 9);
+	P::distance::put(d, 1852.5);
+	P::bearing_ref::put_raw(d, 1);
+	P::perpendicular::put_raw(d, 0);
+	P::arrived::put_raw(d, 1);
+	P::calc_type::put_raw(d, 0);
+	P::eta_time::put(d, 43200.5);
+	P::eta_date::put_raw(d, 20000);
+	P::bearing_orig::put(d, 0.5);
+	P::bearing_pos::put(d, 0.75);
+	P::orig_wp::put_raw(d, 1);
+	P::dest_wp::put_raw(d, 2);
+	P::dest_lat::put(d, -33.875);
+	P::dest_lon::put(d, 151.25);
+	P::closing_speed::put(d, -1.5);
+	check_frame("navdata", d, exp, sizeof(d));
+	FIELD_GET(P, distance, 1852.5);
+	FIELD_GET(P, eta_time, 43200.5);
+	FIELD_GET(P, dest_lat, -33.875);
+	FIELD_GET(P, dest_lon, 151.25);
+	FIELD_GET(P, closing_speed, -1.5);
+}
+
+#define LAYOUT(P) check_layout(#P, (P::layout *)NULL)
+
+int
+main(void)
+{
+	LAYOUT(iso_address_claim_pgn);
+	LAYOUT(n2k_attitude_pgn);
+	LAYOUT(n2k_rateofturn_pgn);
+	LAYOUT(n2k_rudder_pgn);
+	LAYOUT(n2k_heading_pgn);
+	LAYOUT(n2k_position_rapid_pgn);
+	LAYOUT(n2k_cogsog_pgn);
+	LAYOUT(n2k_xte_pgn);
+	LAYOUT(n2k_navdata_pgn);
+
+	check_address_claim();
+	check_attitude();
+	check_rateofturn();
+	check_rudder();
+	check_heading();
+	check_position_rapid();
+	check_cogsog();
+	check_xte();
+	check_navdata();
+
+	if (nfail != 0)
+		errx(1, "%d checks failed", nfail);
+	exit(0);
+}
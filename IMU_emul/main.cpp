@@ -26,75 +26,385 @@
  */
 
 #include <stdio.h>
-#include <pthread.h>
+#include <err.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/select.h>
 #include <iostream>
+#include <algorithm>
 #include "NMEA2000.h"
+#include "nmea2000_evloop.h"
 #include "nmea2000_defs_tx.h"
+#include "nmea2000_defs_rx.h"
+#include "nmea2000_loadgen.h"
+#include "seqlock.h"
+#include "simclock.h"
+#include "simpipe.h"
+#include "simstream.h"
 
-static nmea2000 *n2kp;
-static volatile double rot;
-static double heading;
+/* vessel state, written by the stdin reader, read by the transmit side */
+struct vessel_state {
+	double rot;	/* rad/s */
+	double pitch;	/* rad */
+	double roll;	/* rad */
+};
+static seqlock<vessel_state> vstate;
 
-n2k_attitude_tx *n2k_attitudep;
-n2k_rateofturn_tx *n2k_rateofturnp;
+/* one emulated IMU; only used from the transmit side */
+struct imu {
+	nmea2000 *n2k;
+	n2k_attitude_tx *attitude;
+	n2k_rateofturn_tx *rateofturn;
+	double heading;
+	/*
+	 * one sequence per PGN, counting the skipped intervals too: with
+	 * the same interval, the attitude and rate of turn of a sample have
+	 * the same SID, whatever their order and their late runs.
+	 */
+	unsigned long att_n;
+	unsigned long rot_n;
+	struct timespec last;
+};
+static struct imu *imus;
+static simpipe *sim;	/* in-process sea and rudder emulation, or NULL */
+
+static nmea2000_evloop *evloop;
+static nmea2000_bus *bus;
+static struct simstream instream;
+static struct simstream *outstream;	/* vessel state output, or NULL */
+static int dumppipe[2];	/* SIGUSR1/SIGINFO -> latency dump */
 
 static void
 usage(void)
 {
-	std::cerr << "usage: " << getprogname() << " <canif>" << std::endl;
+	std::cerr << "usage: " << getprogname() << " [-e] [-c clock] [-I fmt] [-O fmt] [-a ms] [-r ms] [-n count]" << std::endl;
+	std::cerr << "           [-l req:resp ...] [-s statsock]" << std::endl;
+	std::cerr << "           [-P knots [-S seed] [-w s:a:p|q:a:t1:t0|r:a:t|w:Hs:Tp[:dir[:gamma]] ...]] <canif>" << std::endl;
+	std::cerr << "       " << getprogname() << " -L load% -m pgn:len:pri:src[:weight] [-m ...] <canif>" << std::endl;
 	exit(1);
 }
 
-static void *
-do_rot(void *p)
+/*
+ * periodic updates, called by the nmea2000 scheduler with the nominal
+ * time of the transmission. The heading is integrated over the time
+ * between two attitude deadlines, so late runs don't change it.
+ */
+static void
+attitude_update(nmea2000_frame_tx *f, const struct timespec *when, void *arg)
+{
+	struct imu *imu = (struct imu *)arg;
+	struct timespec dt;
+	vessel_state vs = vstate.read();
+
+	if (sim != NULL)
+		vs.rot = sim->step(when);
+	if (imu->last.tv_sec != 0 || imu->last.tv_nsec != 0) {
+		timespecsub(when, &imu->last, &dt);
+		imu->heading = imu->heading +
+		    vs.rot * (dt.tv_sec + dt.tv_nsec / 1e9);
+	}
+	imu->last = *when;
+	if (imu->heading < 3.1415927)
+		imu->heading += 6.2831853;
+	if (imu->heading >= 3.1415927)
+		imu->heading -= 6.2831853;
+
+	imu->attitude->update(imu->heading, vs.pitch, vs.roll,
+	    (uint8_t)(imu->att_n++ + f->sched.missed));
+
+	if (outstream != NULL && imu == &imus[0]) {
+		struct simstream_rec rec;
+
+		memset(&rec, 0, sizeof(rec));
+		rec.ts_ns = (uint64_t)when->tv_sec * 1000000000ULL +
+		    when->tv_nsec;
+		simstream_set(&rec, SIMSTREAM_ROT, vs.rot);
+		simstream_set(&rec, SIMSTREAM_PITCH, vs.pitch);
+		simstream_set(&rec, SIMSTREAM_ROLL, vs.roll);
+		simstream_set(&rec, SIMSTREAM_HEADING, imu->heading);
+		if (simstream_write(outstream, &rec) < 0)
+			err(1, "write");
+	}
+}
+
+static void
+rateofturn_update(nmea2000_frame_tx *f, const struct timespec *when, void *arg)
+{
+	struct imu *imu = (struct imu *)arg;
+
+	imu->rateofturn->update(sim != NULL ? sim->step(when) :
+	    vstate.read().rot, (uint8_t)(imu->rot_n++ + f->sched.missed));
+}
+
+/* the autopilot's rudder angle goes straight to the yaw dynamics */
+static void
+command_update(int rudder, void *)
 {
-	heading = 1;
-	uint8_t sid = 0;
-	while (1) {
-		heading = heading + rot * 0.1;
-		if (heading < 3.1415927)
-			heading += 6.2831853;
-		if (heading >= 3.1415927)
-			heading -= 6.2831853;
-
-		n2k_attitudep->update(heading, 0, 0, sid);
-		n2k_rateofturnp->update(rot, sid);
-		n2kp->send_bypgn(NMEA2000_ATTITUDE);
-		n2kp->send_bypgn(NMEA2000_RATEOFTURN);
-		sid++;
-		usleep(100000);
+	sim->set_command(rudder);
+}
+
+/*
+ * input records carry rot, pitch and roll (text lines are "rot [pitch
+ * [roll]]"), missing fields are unchanged. With -P, they carry a pseudo
+ * rudder angle instead, as for rudder2rot.
+ */
+static void
+input_rec(const struct simstream_rec *rec, void *)
+{
+	vessel_state vs = vstate.read();
+
+	if (sim != NULL) {
+		if (rec->valid & (1U << SIMSTREAM_RUDDER))
+			sim->set_offset(rec->v[SIMSTREAM_RUDDER]);
+		return;
+	}
+	if (rec->valid & (1U << SIMSTREAM_ROT))
+		vs.rot = rec->v[SIMSTREAM_ROT];
+	if (rec->valid & (1U << SIMSTREAM_PITCH))
+		vs.pitch = rec->v[SIMSTREAM_PITCH];
+	if (rec->valid & (1U << SIMSTREAM_ROLL))
+		vs.roll = rec->v[SIMSTREAM_ROLL];
+	vstate.write(vs);
+}
+
+/* read what's available from stdin, and parse complete records; false on EOF */
+static bool
+read_stdin(void)
+{
+	return simstream_read(&instream, input_rec, NULL) >= 0;
+}
+
+static void
+ev_stdin(int, void *)
+{
+	if (!read_stdin())
+		evloop->stop();
+}
+
+static void
+dump_signal(int)
+{
+	char c = 0;
+	int e = errno;
+
+	(void)write(dumppipe[1], &c, 1);
+	errno = e;
+}
+
+static void
+ev_dump(int fd, void *)
+{
+	char buf[16];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+	bus->print_latency(std::cerr, true);
+}
+
+/* wait for stdin lines and dump requests */
+static void
+input_loop(void)
+{
+	fd_set read_set;
+
+	for (;;) {
+		FD_ZERO(&read_set);
+		FD_SET(STDIN_FILENO, &read_set);
+		FD_SET(dumppipe[0], &read_set);
+		if (select(std::max(STDIN_FILENO, dumppipe[0]) + 1,
+		    &read_set, NULL, NULL, NULL) < 0) {
+			if (errno == EINTR)
+				continue;
+			err(1, "select");
+		}
+		if (FD_ISSET(dumppipe[0], &read_set))
+			ev_dump(dumppipe[0], NULL);
+		if (FD_ISSET(STDIN_FILENO, &read_set) &&
+		    !read_stdin())
+			return;
 	}
 }
 
 int
 main(int argc, const char *argv[])
 {
-	pthread_t rot_thread;
-	char buf[80];
-	char *e;
-	double d;
+	bool use_evloop = false;
+	int attitude_ms = 100;
+	int rateofturn_ms = 100;
+	int nimus = 1;
+	double load = 0;
+	std::vector<const char *> loadmix;
+	std::vector<std::pair<int, int> > latpairs;
+	const char *statsock = NULL;
+	const char *clockspec = NULL;
+	double knots = -1;
+	int infmt = 0, outfmt = -1;
+	std::vector<const char *> waves;
+	unsigned long seed = time(NULL);
+	int ch, req, resp;
 
-	if (argc != 2) {
+	while ((ch = getopt(argc, (char **)argv, "ec:I:O:a:r:n:L:m:l:s:P:S:w:")) != -1) {
+		switch (ch) {
+		case 'e':
+			use_evloop = true;
+			break;
+		case 'c':
+			clockspec = optarg;
+			break;
+		case 'I':
+			if ((infmt = simstream_format(optarg)) < 0)
+				usage();
+			break;
+		case 'O':
+			if ((outfmt = simstream_format(optarg)) < 0)
+				usage();
+			break;
+		case 'a':
+			attitude_ms = atoi(optarg);
+			break;
+		case 'r':
+			rateofturn_ms = atoi(optarg);
+			break;
+		case 'n':
+			nimus = atoi(optarg);
+			break;
+		case 'L':
+			load = strtod(optarg, NULL) / 100.0;
+			break;
+		case 'm':
+			loadmix.push_back(optarg);
+			break;
+		case 'l':
+			if (sscanf(optarg, "%d:%d", &req, &resp) != 2)
+				usage();
+			latpairs.push_back(std::make_pair(req, resp));
+			break;
+		case 's':
+			statsock = optarg;
+			break;
+		case 'P':
+			knots = strtod(optarg, NULL);
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			waves.push_back(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 1 || attitude_ms <= 0 || rateofturn_ms <= 0 ||
+	    nimus < 1 || nimus >= NMEA2000_ADDR_MAX) {
 		usage();
 	}
-	n2kp = new nmea2000(argv[1]);
-	n2kp->Init();
-	n2k_attitudep = (n2k_attitude_tx *)n2kp->get_frametx(n2kp->get_tx_bypgn(NMEA2000_ATTITUDE));
-	n2k_rateofturnp = (n2k_rateofturn_tx *)n2kp->get_frametx(n2kp->get_tx_bypgn(NMEA2000_RATEOFTURN));
-
-	n2kp->tx_enable(n2kp->get_tx_bypgn(NMEA2000_ATTITUDE), true);
-	n2kp->tx_enable(n2kp->get_tx_bypgn(NMEA2000_RATEOFTURN), true);
-	rot = 0;
-	heading = 0;
-	if (pthread_create(&rot_thread, NULL, do_rot, NULL) != 0) {
-		perror("rot_thread");
-		exit(1);
+	if (simclock_init(clockspec) < 0)
+		usage();
+	/* the fast clock only moves when the event loop waits */
+	if (simclock_mode() == SIMCLOCK_FAST)
+		use_evloop = true;
+	if (load > 0) {
+		/* bus load generator instead of IMUs */
+		nmea2000_loadgen lg(load);
+		if (loadmix.empty() || load > 1)
+			usage();
+		for (size_t i = 0; i < loadmix.size(); i++) {
+			if (!lg.add(loadmix[i]))
+				usage();
+		}
+		bus = new nmea2000_bus(argv[0]);
+		bus->Init();
+		bus->wait_configured();
+		lg.run(bus->getsock(), std::cout);
+		exit(0);
 	}
-	while (fgets(buf, sizeof(buf) - 1, stdin) != NULL) {
-		d = strtod(buf, &e);
-		if ((*e == '\0' || *e == '\n') && e != buf)  {
-			rot = d;
+	if (knots >= 0) {
+		sim = new simpipe(knots);
+		for (size_t i = 0; i < waves.size(); i++) {
+			if (waves[i][0] == '\0' || waves[i][1] != ':' ||
+			    !sim->add_perturb(waves[i][0], &waves[i][2]))
+				usage();
 		}
+		srandom(seed);
+	} else if (!waves.empty()) {
+		usage();
+	}
+	simstream_init(&instream, STDIN_FILENO, infmt,
+	    sim != NULL ? SIMSTREAM_RUDDER : SIMSTREAM_ROT);
+	if (outfmt >= 0) {
+		outstream = new struct simstream;
+		simstream_init(outstream, STDOUT_FILENO, outfmt, SIMSTREAM_ROT);
+	}
+	if (use_evloop)
+		evloop = new nmea2000_evloop;
+	/* all the IMUs share the same socket and receive loop */
+	bus = new nmea2000_bus(argv[0]);
+	for (size_t i = 0; i < latpairs.size(); i++) {
+		if (!bus->add_latency(latpairs[i].first, latpairs[i].second))
+			usage();
+	}
+	imus = new struct imu[nimus];
+	memset(imus, 0, sizeof(struct imu) * nimus);
+	for (int i = 0; i < nimus; i++) {
+		struct imu *imu = &imus[i];
+		nmea2000 *n2kp;
+
+		n2kp = imu->n2k = new nmea2000(bus);
+		n2kp->setaddress((0x80 + i) % NMEA2000_ADDR_MAX);
+		n2kp->Init();
+		imu->attitude = (n2k_attitude_tx *)n2kp->get_frametx(n2kp->get_tx_bypgn(NMEA2000_ATTITUDE));
+		imu->rateofturn = (n2k_rateofturn_tx *)n2kp->get_frametx(n2kp->get_tx_bypgn(NMEA2000_RATEOFTURN));
+
+		n2kp->tx_enable(n2kp->get_tx_bypgn(NMEA2000_ATTITUDE), true);
+		n2kp->tx_enable(n2kp->get_tx_bypgn(NMEA2000_RATEOFTURN), true);
+		imu->heading = 1;
+		imu->att_n = imu->rot_n = 0;
+		n2kp->set_periodic(NMEA2000_ATTITUDE, attitude_ms,
+		    attitude_update, imu);
+		n2kp->set_periodic(NMEA2000_RATEOFTURN, rateofturn_ms,
+		    rateofturn_update, imu);
+	}
+	if (sim != NULL) {
+		nmea2000 *n2kp = imus[0].n2k;
+		int i = n2kp->get_rx_bypgn(PRIVATE_COMMAND_STATUS);
+
+		((nmea2000_command_rx *)n2kp->get_framerx(i))->set_cb(
+		    command_update, NULL);
+		n2kp->rx_enable(i, true);
+	}
+	bus->Init(evloop);
+	if (statsock != NULL && !bus->start_stats(statsock))
+		exit(1);
+
+	if (pipe(dumppipe) < 0)
+		err(1, "pipe");
+	fcntl(dumppipe[0], F_SETFL, fcntl(dumppipe[0], F_GETFL) | O_NONBLOCK);
+	fcntl(dumppipe[1], F_SETFL, fcntl(dumppipe[1], F_GETFL) | O_NONBLOCK);
+	signal(SIGUSR1, dump_signal);
+#ifdef SIGINFO
+	signal(SIGINFO, dump_signal);
+#endif
+	if (use_evloop) {
+		/* everything runs in this thread */
+		evloop->add_fd(STDIN_FILENO, ev_stdin, NULL);
+		evloop->add_fd(dumppipe[0], ev_dump, NULL);
+		evloop->run();
+	} else {
+		input_loop();
 	}
+	imus[0].n2k->print_rx_stats(std::cerr);
+	imus[0].n2k->print_tx_stats(std::cerr);
+	bus->print_latency(std::cerr, true);
+	for (int i = 0; i < nimus; i++)
+		delete imus[i].n2k;
+	delete bus;
+	delete[] imus;
+	delete sim;
+	delete outstream;
 	exit(0);
 }
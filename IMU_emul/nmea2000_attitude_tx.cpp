@@ -33,9 +33,12 @@
 void
 n2k_attitude_tx::update(double yaw, double pitch, double roll, uint8_t sid)
 {
-	uint82frame(sid, 0);
-	int162frame(yaw * 10000, 1);
-	int162frame(pitch * 10000, 3);
-	int162frame(roll * 10000, 5);
-	valid = true;
+	typedef n2k_attitude_pgn P;
+
+	P::layout::init(data);
+	P::sid::put_raw(data, sid);
+	P::yaw::put(data, yaw);
+	P::pitch::put(data, pitch);
+	P::roll::put(data, roll);
+	updated();
 }
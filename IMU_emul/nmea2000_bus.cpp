@@ -0,0 +1,877 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <net/if.h>
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include "NMEA2000.h"
+#include "nmea2000_evloop.h"
+#include "nmea2000_defs_tx.h"
+#include "nmea2000_defs_rx.h"
+#include "simclock.h"
+
+nmea2000_bus::nmea2000_bus(const char *ifname) {
+    canif = ifname;
+    sock = -1;
+    configured = false;
+    byaddr_valid = false;
+    thread_running = 0;
+    sched_running = 0;
+    wakeup[0] = wakeup[1] = -1;
+    evloop = NULL;
+
+    pthread_condattr_t ca;
+    pthread_condattr_init(&ca);
+    pthread_condattr_setclock(&ca, CLOCK_MONOTONIC);
+    pthread_cond_init(&sched_cv, &ca);
+    pthread_cond_init(&state_cv, &ca);
+    pthread_condattr_destroy(&ca);
+    pthread_mutex_init(&mtx, NULL);
+    conf_retry = NMEA2000_CONF_RETRY_MIN;
+
+    tstamp_on = false;
+    tx_tstamp = false;
+    stats_srv = NULL;
+    rxq_ovfl = false;
+    tx_pollout = tx_retry_set = false;
+    txq.setcb(nmea2000_bus::tx_sent, nmea2000_bus::tx_blocked, this);
+    txq.stats = &stats;
+    rx_batch = NMEA2000_RX_BATCH;
+    memset(rx_msgs, 0, sizeof(rx_msgs));
+    for (int i = 0; i < NMEA2000_RX_BATCH; i++) {
+	rx_iov[i].iov_base = &rx_frames[i];
+	rx_iov[i].iov_len = sizeof(struct can_frame);
+	rx_msgs[i].msg_hdr.msg_iov = &rx_iov[i];
+	rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    memset(rx_batch_hist, 0, sizeof(rx_batch_hist));
+}
+
+nmea2000_bus::~nmea2000_bus(void)
+{
+    char c = 0;
+
+    delete stats_srv;
+    if (evloop != NULL) {
+	evloop->del_fd(sock);
+	evloop->timer_stop(claim_timer);
+	evloop->timer_stop(sched_timer);
+	evloop->timer_stop(tx_timer);
+	evloop->del_wfd(sock);
+    }
+    if (sched_running) {
+	pthread_mutex_lock(&mtx);
+	sched_running = 0;
+	pthread_cond_signal(&sched_cv);
+	pthread_mutex_unlock(&mtx);
+	pthread_join(sched_thr, NULL);
+    }
+    while (thread_running) {
+	thread_running = 0;
+	(void)write(wakeup[1], &c, 1);
+	pthread_join(thread, NULL);
+    }
+    close(wakeup[0]);
+    close(wakeup[1]);
+    close(sock);
+    pthread_cond_destroy(&sched_cv);
+    pthread_cond_destroy(&state_cv);
+    pthread_mutex_destroy(&mtx);
+}
+
+/*
+ * with a loop, the bus runs from the caller's event loop and no thread
+ * is created; otherwise a rx thread handles the socket and address
+ * claims, and a tx thread runs the periodic schedule.
+ */
+void nmea2000_bus::Init(nmea2000_evloop *loop) {
+
+    if ((sock = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+	err(1, "create CAN socket");
+	return;
+    }
+    if (latency.size() > 0)
+	tstamp_enable();
+    txq.setsock(sock);
+    update_filter();
+    if (loop != NULL) {
+	evloop = loop;
+	claim_timer = evloop->add_timer(nmea2000_bus::ev_claim, this);
+	sched_timer = evloop->add_timer(nmea2000_bus::ev_sched, this);
+	tx_timer = evloop->add_timer(nmea2000_bus::ev_txretry, this);
+	evloop->timer_in(claim_timer, 0);
+	evloop->timer_in(sched_timer, 0);
+	return;
+    }
+    if (pipe(wakeup) < 0) {
+	err(1, "pipe");
+	return;
+    }
+    fcntl(wakeup[1], F_SETFL, fcntl(wakeup[1], F_GETFL) | O_NONBLOCK);
+    fcntl(wakeup[0], F_SETFL, fcntl(wakeup[0], F_GETFL) | O_NONBLOCK);
+    thread_running = 1;
+    if (pthread_create(&thread, NULL, nmea2000_bus::rx_thread, this)) {
+        err(1, "can't create rx thread");
+	return;
+    }
+    sched_changed();
+}
+
+void nmea2000_bus::attach(nmea2000 *n)
+{
+	pthread_mutex_lock(&mtx);
+	if (std::find(nodes.begin(), nodes.end(), n) == nodes.end())
+		nodes.push_back(n);
+	n->nmea2000_txP->latency = &latency;
+	n->nmea2000_txP->stats = &stats;
+	n->nmea2000_txP->txq = &txq;
+	byaddr_valid = false;
+	pthread_mutex_unlock(&mtx);
+	update_filter();
+	claim_changed();
+	sched_changed();
+}
+
+void nmea2000_bus::detach(nmea2000 *n)
+{
+	std::vector<nmea2000 *>::iterator it;
+
+	pthread_mutex_lock(&mtx);
+	it = std::find(nodes.begin(), nodes.end(), n);
+	if (it != nodes.end())
+		nodes.erase(it);
+	byaddr_valid = false;
+	pthread_mutex_unlock(&mtx);
+}
+
+void *
+nmea2000_bus::rx_thread(void *p)
+{
+    nmea2000_bus *busp = (nmea2000_bus *)p;
+    struct timespec now, next, ts, txretry;
+    struct timeval timeout;
+    fd_set read_set, write_set;
+    bool pending, pollout, retryset;
+    int sret, retry, maxfd;
+    char buf[16];
+
+    while (busp->thread_running) {
+	FD_ZERO(&read_set);
+	FD_ZERO(&write_set);
+	FD_SET(busp->wakeup[0], &read_set);
+	maxfd = busp->wakeup[0];
+	if (!busp->configured && !busp->try_configure(&retry)) {
+		/* retry later, unless we're told to exit */
+		timeout.tv_sec = retry / 1000;
+		timeout.tv_usec = (retry % 1000) * 1000;
+		if (select(maxfd + 1, &read_set, NULL, NULL, &timeout) > 0) {
+			while (read(busp->wakeup[0], buf, sizeof(buf)) > 0)
+				;
+		}
+		continue;
+	}
+	pthread_mutex_lock(&busp->mtx);
+	pending = busp->claim_run(&next);
+	pollout = busp->tx_pollout;
+	retryset = busp->tx_retry_set;
+	txretry = busp->tx_retry;
+	pthread_mutex_unlock(&busp->mtx);
+
+	/* the earliest of the claim and tx queue deadlines */
+	if (retryset && (!pending || timespeccmp(&txretry, &next, <))) {
+		next = txretry;
+		pending = true;
+	}
+	timeout.tv_sec = 1;
+	timeout.tv_usec = 0;
+	if (pending) {
+		simclock_timeout(&next, &ts);
+		if (ts.tv_sec < 1) {
+			timeout.tv_sec = 0;
+			timeout.tv_usec = ts.tv_nsec / 1000 + 1;
+		}
+	}
+
+	FD_SET(busp->sock, &read_set);
+	if (pollout)
+		FD_SET(busp->sock, &write_set);
+	sret = select(std::max(busp->sock, maxfd) + 1,
+	    &read_set, &write_set, NULL, &timeout);
+	switch(sret) {
+	case -1:
+		if (errno != EINTR)
+			warn("select");
+		break;
+	case 0:
+		break;
+	default:
+		if (FD_ISSET(busp->wakeup[0], &read_set)) {
+			while (read(busp->wakeup[0], buf, sizeof(buf)) > 0)
+				;
+		}
+		if (FD_ISSET(busp->sock, &read_set)) {
+			pthread_mutex_lock(&busp->mtx);
+			busp->receive();
+			pthread_mutex_unlock(&busp->mtx);
+		}
+		break;
+	}
+	if (sret >= 0 && (pollout || retryset)) {
+		nmea2000_evloop::now(&now);
+		if ((pollout && sret > 0 &&
+		    FD_ISSET(busp->sock, &write_set)) ||
+		    (retryset && timespeccmp(&txretry, &now, <=))) {
+			pthread_mutex_lock(&busp->mtx);
+			busp->tx_pollout = busp->tx_retry_set = false;
+			busp->txq.flush();
+			pthread_mutex_unlock(&busp->mtx);
+		}
+	}
+    }
+    return 0;
+}
+
+/*
+ * bind the socket to the interface. On failure, *retry is when to try
+ * again, in ms: the delay doubles up to NMEA2000_CONF_RETRY_MAX, so a
+ * missing interface is picked up quickly once it appears.
+ */
+bool nmea2000_bus::try_configure(int *retry)
+{
+	if (!configure()) {
+		*retry = conf_retry;
+		conf_retry = std::min(conf_retry * 2, NMEA2000_CONF_RETRY_MAX);
+		return false;
+	}
+	pthread_mutex_lock(&mtx);
+	configured = true;
+	conf_retry = NMEA2000_CONF_RETRY_MIN;
+	pthread_cond_broadcast(&state_cv);
+	pthread_mutex_unlock(&mtx);
+	return true;
+}
+
+/*
+ * wait up to ms milliseconds (forever if < 0) for the interface to be
+ * configured, and for n's address to be claimed if n is not NULL.
+ */
+bool nmea2000_bus::wait_state(nmea2000 *n, int ms)
+{
+	struct timespec deadline;
+	bool done;
+
+	nmea2000_evloop::now(&deadline);
+	nmea2000_evloop::addms(&deadline, ms < 0 ? 0 : ms);
+	simclock_realtime(&deadline, &deadline);
+	pthread_mutex_lock(&mtx);
+	for (;;) {
+		done = configured && (n == NULL || n->state == nmea2000::CLAIMED);
+		if (done)
+			break;
+		if (ms < 0)
+			pthread_cond_wait(&state_cv, &mtx);
+		else if (pthread_cond_timedwait(&state_cv, &mtx, &deadline) ==
+		    ETIMEDOUT)
+			break;
+	}
+	done = configured && (n == NULL || n->state == nmea2000::CLAIMED);
+	pthread_mutex_unlock(&mtx);
+	return done;
+}
+
+bool nmea2000_bus::wait_configured(int ms)
+{
+	return wait_state(NULL, ms);
+}
+
+/* run the claim state machine of every device; called with mtx held */
+bool nmea2000_bus::claim_run(struct timespec *next)
+{
+	struct timespec now, n;
+	bool pending = false;
+
+	nmea2000_evloop::now(&now);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (!nodes[i]->claim_step(&now, &n))
+			continue;
+		if (!pending || timespeccmp(&n, next, <)) {
+			*next = n;
+			pending = true;
+		}
+	}
+	return pending;
+}
+
+/* a device needs its claim state machine to run soon */
+void nmea2000_bus::claim_changed()
+{
+	char c = 0;
+
+	if (evloop != NULL) {
+		if (configured)
+			evloop->timer_in(claim_timer, 0);
+	} else if (thread_running) {
+		(void)write(wakeup[1], &c, 1);
+	}
+}
+
+/*
+ * address claims sent on our socket are not received back by it:
+ * hand them to the other devices sharing it.
+ */
+void nmea2000_bus::claim_loopback(nmea2000 *from, const nmea2000_frame &f)
+{
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i] != from)
+			nodes[i]->handle_address_claim(f);
+	}
+}
+
+/* event loop mode: bus configuration, then address claims */
+void
+nmea2000_bus::ev_claim(int id, void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+	struct timespec next;
+
+	int retry;
+
+	if (!busp->configured) {
+		if (!busp->try_configure(&retry)) {
+			busp->evloop->timer_in(id, retry);
+			return;
+		}
+		busp->evloop->add_fd(busp->sock, nmea2000_bus::ev_read, busp);
+	}
+	if (busp->claim_run(&next))
+		busp->evloop->timer_at(id, &next);
+}
+
+void
+nmea2000_bus::ev_read(int, void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+
+	busp->receive();
+}
+
+/* the schedule of a device changed, recompute the next deadline */
+void nmea2000_bus::sched_changed()
+{
+	if (evloop != NULL) {
+		evloop->timer_in(sched_timer, 0);
+		return;
+	}
+	if (!thread_running)
+		return;
+	pthread_mutex_lock(&mtx);
+	if (!sched_running) {
+		sched_running = 1;
+		if (pthread_create(&sched_thr, NULL, nmea2000_bus::sched_thread, this))
+			err(1, "can't create tx thread");
+	}
+	pthread_cond_signal(&sched_cv);
+	pthread_mutex_unlock(&mtx);
+}
+
+/* a frame left the tx queue; let its device account for it */
+void nmea2000_bus::tx_sent(const struct can_frame *cf, void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+	nmea2000 *n = busp->node_byaddr(cf->can_id & 0xff);
+
+	if (n != NULL)
+		n->nmea2000_txP->tx_done(cf);
+	else
+		busp->stats.tx(cf);
+}
+
+/* the tx queue is stuck; flush it again when the socket allows it */
+void nmea2000_bus::tx_blocked(bool pollout, const struct timespec *retry,
+    void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+	char c = 0;
+
+	if (busp->evloop != NULL) {
+		if (pollout)
+			busp->evloop->add_wfd(busp->sock, ev_write, busp);
+		else
+			busp->evloop->timer_at(busp->tx_timer, retry);
+		return;
+	}
+	busp->tx_pollout = pollout;
+	busp->tx_retry_set = !pollout;
+	if (!pollout)
+		busp->tx_retry = *retry;
+	(void)write(busp->wakeup[1], &c, 1);
+}
+
+void
+nmea2000_bus::ev_write(int fd, void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+
+	busp->evloop->del_wfd(fd);
+	busp->txq.flush();
+}
+
+void
+nmea2000_bus::ev_txretry(int, void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+
+	busp->txq.flush();
+}
+
+/* run the periodic schedule of every device; called with mtx held */
+bool nmea2000_bus::sched_run(struct timespec *next)
+{
+	struct timespec n;
+	bool pending = false;
+
+	for (size_t i = 0; i < nodes.size(); i++) {
+		nmea2000 *node = nodes[i];
+		if (!node->nmea2000_txP->sched_run(sock,
+		    node->state == nmea2000::CLAIMED, &n))
+			continue;
+		if (!pending || timespeccmp(&n, next, <)) {
+			*next = n;
+			pending = true;
+		}
+	}
+	return pending;
+}
+
+void
+nmea2000_bus::ev_sched(int id, void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+	struct timespec next;
+
+	if (busp->sched_run(&next))
+		busp->evloop->timer_at(id, &next);
+}
+
+/* sleep until the next absolute deadline; sched_changed() wakes us up */
+void *
+nmea2000_bus::sched_thread(void *p)
+{
+	nmea2000_bus *busp = (nmea2000_bus *)p;
+	struct timespec next;
+
+	pthread_mutex_lock(&busp->mtx);
+	while (busp->sched_running) {
+		if (!busp->sched_run(&next)) {
+			nmea2000_evloop::now(&next);
+			nmea2000_evloop::addms(&next, 1000);
+		}
+		simclock_realtime(&next, &next);
+		pthread_cond_timedwait(&busp->sched_cv, &busp->mtx, &next);
+	}
+	pthread_mutex_unlock(&busp->mtx);
+	return 0;
+}
+
+/*
+ * drain up to rx_batch frames from the socket with a single recvmmsg(),
+ * and dispatch them in order, with their receive timestamp.
+ */
+void nmea2000_bus::receive()
+{
+	struct timespec ts, t0, t1;
+	bool cmsg = tstamp_on || rxq_ovfl;
+	uint32_t drops;
+	int n, i;
+
+	if (tx_tstamp)
+		receive_txstamps();
+	for (i = 0; i < rx_batch; i++) {
+		rx_msgs[i].msg_hdr.msg_control = cmsg ? rx_cmsg[i] : NULL;
+		rx_msgs[i].msg_hdr.msg_controllen =
+		    cmsg ? NMEA2000_CMSG_SIZE : 0;
+	}
+
+	if (rx_batch <= 1) {
+		ssize_t r = recvmsg(sock, &rx_msgs[0].msg_hdr, MSG_DONTWAIT);
+		switch(r) {
+		case -1:
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				warn("read CAN socket");
+			return;
+		case 0:
+			/* EOF ? */
+			return;
+		default:
+			rx_msgs[0].msg_len = r;
+			n = 1;
+			break;
+		}
+	} else {
+		n = recvmmsg(sock, rx_msgs, rx_batch, MSG_DONTWAIT, NULL);
+		if (n < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				warn("recvmmsg CAN socket");
+			return;
+		}
+	}
+	rx_batch_hist[n]++;
+	for (i = 0; i < n; i++) {
+		if (rx_msgs[i].msg_len < sizeof(struct can_frame))
+			continue;
+		nmea2000_frame n2kframe(&rx_frames[i]);
+		stats.rx(&rx_frames[i]);
+		if (rxq_ovfl &&
+		    nmea2000_stats::rxq_ovfl_get(&rx_msgs[i].msg_hdr, &drops))
+			stats.rx_dropped = drops;
+		if (tstamp_on) {
+			if (!nmea2000_tstamp_get(&rx_msgs[i].msg_hdr, &ts))
+				clock_gettime(CLOCK_REALTIME, &ts);
+			n2kframe.settstamp(&ts);
+			if (latency.isrequest(n2kframe.getpgn()))
+				latency.request(n2kframe.getpgn(), &ts);
+		}
+		if (!stats.timing) {
+			dispatch(n2kframe);
+			continue;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		dispatch(n2kframe);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		timespecsub(&t1, &t0, &t1);
+		stats.rx_time(n2kframe.getpgn(),
+		    t1.tv_sec * 1000000000UL + t1.tv_nsec);
+	}
+}
+
+/*
+ * our frames come back on the error queue with their transmit timestamp;
+ * the socket is readable as long as the queue is not empty.
+ */
+void nmea2000_bus::receive_txstamps()
+{
+	struct timespec ts;
+	int n, i;
+
+	do {
+		for (i = 0; i < NMEA2000_RX_BATCH; i++) {
+			rx_msgs[i].msg_hdr.msg_control = rx_cmsg[i];
+			rx_msgs[i].msg_hdr.msg_controllen = NMEA2000_CMSG_SIZE;
+		}
+		n = recvmmsg(sock, rx_msgs, NMEA2000_RX_BATCH,
+		    MSG_ERRQUEUE | MSG_DONTWAIT, NULL);
+		for (i = 0; i < n; i++) {
+			if (rx_msgs[i].msg_len < sizeof(struct can_frame) ||
+			    !nmea2000_tstamp_gettx(&rx_msgs[i].msg_hdr, &ts))
+				continue;
+			nmea2000_frame n2kframe(&rx_frames[i]);
+			n2kframe.settstamp(&ts);
+			/* the driver stamps our frames, stop doing it */
+			latency.kernel_tx = true;
+			latency.response(n2kframe.getpgn(), &ts);
+			for (size_t j = 0; j < nodes.size(); j++) {
+				if (nodes[j]->nmea2000_txP->tx_stamp(
+				    &rx_frames[i], &ts))
+					break;
+			}
+		}
+	} while (n == NMEA2000_RX_BATCH);
+}
+
+/*
+ * timestamp our frames. Transmit timestamps are taken in userland until
+ * the first one comes back from the kernel (older kernels accept the
+ * option but never send them).
+ */
+void nmea2000_bus::tstamp_enable()
+{
+	if (tstamp_on || sock < 0)
+		return;
+	tx_tstamp = nmea2000_tstamp_enable(sock);
+	tstamp_on = true;
+}
+
+/*
+ * measure the time from the reception of req_pgn to the transmission of
+ * the next resp_pgn by one of our devices. This enables timestamps, and
+ * adds req_pgn to the receive filter.
+ */
+bool nmea2000_bus::add_latency(int req_pgn, int resp_pgn)
+{
+	if (!latency.add(req_pgn, resp_pgn))
+		return false;
+	tstamp_enable();
+	update_filter();
+	return true;
+}
+
+void nmea2000_bus::print_latency(std::ostream &os, bool buckets)
+{
+	latency.print(os, buckets);
+}
+
+/*
+ * serve the counters in Prometheus text format on spec (a Unix socket
+ * path or a localhost TCP port). Call after Init().
+ */
+bool nmea2000_bus::start_stats(const char *spec)
+{
+	if (stats_srv != NULL)
+		return false;
+	stats_srv = new nmea2000_stats_server(metrics_cb, this);
+	if (!stats_srv->start(spec, evloop)) {
+		delete stats_srv;
+		stats_srv = NULL;
+		return false;
+	}
+	if (sock >= 0)
+		rxq_ovfl = nmea2000_stats::rxq_ovfl_enable(sock);
+	stats.timing = true;
+	return true;
+}
+
+void nmea2000_bus::metrics_cb(std::ostream &os, void *p)
+{
+	((nmea2000_bus *)p)->print_metrics(os);
+}
+
+/*
+ * the bus counters are read without locking; the device list and
+ * schedules need the bus lock, but that's not the hot path.
+ */
+void nmea2000_bus::print_metrics(std::ostream &os)
+{
+	static const struct {
+		const char *name;
+		const char *help;
+	} fastm[] = {
+		{ "nmea2000_fast_complete_total", "fast packets reassembled" },
+		{ "nmea2000_fast_lost_total", "fast packets with lost segments" },
+		{ "nmea2000_fast_timeout_total", "fast packets timed out" },
+		{ "nmea2000_fast_noslot_total", "fast packets without a slot" },
+		{ "nmea2000_fast_bad_total", "invalid fast packet segments" },
+	};
+	const nmea2000_desc *d;
+
+	stats.print(os);
+	txq.print_metrics(os);
+	latency.print_metrics(os);
+	pthread_mutex_lock(&mtx);
+	os << "# HELP nmea2000_device_address current device address" << std::endl;
+	os << "# TYPE nmea2000_device_address gauge" << std::endl;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		os << "nmea2000_device_address{device=\"" << i << "\"} "
+		    << nodes[i]->getaddress() << std::endl;
+	}
+	os << "# HELP nmea2000_device_claimed 1 if the address is claimed" << std::endl;
+	os << "# TYPE nmea2000_device_claimed gauge" << std::endl;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		os << "nmea2000_device_claimed{device=\"" << i << "\"} "
+		    << nodes[i]->isclaimed() << std::endl;
+	}
+	for (size_t m = 0; m < sizeof(fastm) / sizeof(fastm[0]); m++) {
+		os << "# HELP " << fastm[m].name << " " << fastm[m].help << std::endl;
+		os << "# TYPE " << fastm[m].name << " counter" << std::endl;
+		for (size_t i = 0; i < nodes.size(); i++) {
+			nmea2000_rx *rx = nodes[i]->nmea2000_rxP;
+			const nmea2000_counter *c[] = { &rx->fast_stats.complete,
+			    &rx->fast_stats.lost, &rx->fast_stats.timeout,
+			    &rx->fast_stats.noslot, &rx->fast_stats.bad };
+			os << fastm[m].name << "{device=\"" << i << "\"} "
+			    << c[m]->get() << std::endl;
+		}
+	}
+	os << "# HELP nmea2000_sched_sent_total periodic transmissions" << std::endl;
+	os << "# TYPE nmea2000_sched_sent_total counter" << std::endl;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		for (int j = 0; (d = nodes[i]->get_tx_byindex(j)) != NULL; j++) {
+			nmea2000_sched *s = &nodes[i]->get_frametx(j)->sched;
+			if (s->interval <= 0)
+				continue;
+			os << "nmea2000_sched_sent_total{device=\"" << i
+			    << "\",pgn=\"" << d->pgn << "\"} " << s->sent
+			    << std::endl;
+		}
+	}
+	os << "# HELP nmea2000_sched_missed_total periodic deadlines skipped" << std::endl;
+	os << "# TYPE nmea2000_sched_missed_total counter" << std::endl;
+	for (size_t i = 0; i < nodes.size(); i++) {
+		for (int j = 0; (d = nodes[i]->get_tx_byindex(j)) != NULL; j++) {
+			nmea2000_sched *s = &nodes[i]->get_frametx(j)->sched;
+			if (s->interval <= 0)
+				continue;
+			os << "nmea2000_sched_missed_total{device=\"" << i
+			    << "\",pgn=\"" << d->pgn << "\"} " << s->missed
+			    << std::endl;
+		}
+	}
+	pthread_mutex_unlock(&mtx);
+}
+
+/* the device using address a, or NULL; called with mtx held */
+nmea2000 *nmea2000_bus::node_byaddr(int a)
+{
+	if (!byaddr_valid) {
+		memset(byaddr, 0, sizeof(byaddr));
+		for (size_t i = 0; i < nodes.size(); i++) {
+			int a = nodes[i]->getaddress();
+			if (byaddr[a] == NULL)
+				byaddr[a] = nodes[i];
+		}
+		byaddr_valid = true;
+	}
+	return byaddr[a & 0xff];
+}
+
+/* frames for a given address go to this device only, others to all */
+void nmea2000_bus::dispatch(const nmea2000_frame &n2kf)
+{
+	nmea2000 *n;
+
+	if (n2kf.is_pdu1() && n2kf.getdst() != NMEA2000_ADDR_GLOBAL) {
+		if ((n = node_byaddr(n2kf.getdst())) != NULL)
+			n->parse_frame(n2kf);
+		return;
+	}
+	for (size_t i = 0; i < nodes.size(); i++)
+		nodes[i]->parse_frame(n2kf);
+}
+
+void nmea2000_bus::set_rx_batch(int n)
+{
+	if (n < 1)
+		n = 1;
+	if (n > NMEA2000_RX_BATCH)
+		n = NMEA2000_RX_BATCH;
+	rx_batch = n;
+}
+
+void nmea2000_bus::print_rx_stats(std::ostream &os)
+{
+	unsigned long batches = 0, frames = 0;
+
+	for (int i = 1; i <= NMEA2000_RX_BATCH; i++) {
+		batches += rx_batch_hist[i];
+		frames += rx_batch_hist[i] * i;
+	}
+	os << "rx: " << frames << " frames in " << batches << " batches";
+	if (batches != 0)
+		os << " (" << (double)frames / batches << " frames/batch)";
+	os << std::endl;
+	for (int i = 1; i <= NMEA2000_RX_BATCH; i++) {
+		if (rx_batch_hist[i] != 0)
+			os << "  " << i << ": " << rx_batch_hist[i] << std::endl;
+	}
+}
+
+bool nmea2000_bus::configure()
+{
+    static bool warned;
+    struct ifreq ifr;
+    struct sockaddr_can addr;
+
+    memset(&ifr, 0, sizeof(ifr));
+    if (canif != NULL) {
+	strcpy(ifr.ifr_name, canif);
+	if (ioctl(sock, SIOCGIFINDEX, &ifr) < 0) {
+	    if (!warned) {
+		std::cerr << "can't get index for CAN interface " << canif << std::endl;
+		warned = true;
+	    }
+	    return false;
+        }
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = ifr.ifr_ifindex;
+        if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	    if (!warned) {
+	        warn("can't bind CAN socket to %s", canif);
+		warned = true;
+	    }
+	    return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+/*
+ * program the socket's CAN_RAW_FILTER with the PGNs the devices handle,
+ * so that the kernel drops the other frames before they reach us.
+ */
+void nmea2000_bus::update_filter()
+{
+	std::vector<struct can_filter> cfi;
+	std::vector<int> pgns;
+	const nmea2000_desc *d;
+
+	if (sock < 0)
+		return;
+
+	pgns.push_back(ISO_ADDRESS_CLAIM);
+	pgns.push_back(ISO_REQUEST);
+	for (int i = 0; i < latency.size(); i++)
+		pgns.push_back(latency.getrequest(i));
+	pthread_mutex_lock(&mtx);
+	for (size_t n = 0; n < nodes.size(); n++) {
+		for (int i = 0; (d = nodes[n]->get_rx_byindex(i)) != NULL; i++) {
+			if (d->enabled)
+				pgns.push_back(d->pgn);
+		}
+	}
+	pthread_mutex_unlock(&mtx);
+	std::sort(pgns.begin(), pgns.end());
+	pgns.erase(std::unique(pgns.begin(), pgns.end()), pgns.end());
+	for (size_t i = 0; i < pgns.size(); i++)
+		add_filter(cfi, pgns[i]);
+	if (setsockopt(sock, SOL_CAN_RAW, CAN_RAW_FILTER,
+	    &cfi[0], cfi.size() * sizeof(cfi[0])) < 0) {
+		warn("setsockopt(CAN_RAW_FILTER)");
+	}
+}
+
+void nmea2000_bus::add_filter(std::vector<struct can_filter> &cfi, int pgn)
+{
+	struct can_filter f;
+
+	f.can_id = ((canid_t)pgn << 8) | CAN_EFF_FLAG;
+	/* for PDU1 PGNs the low byte is the destination; checked later */
+	if (((pgn >> 8) & 0xff) < 240)
+		f.can_mask = (0x1ff00 << 8) | CAN_EFF_FLAG;
+	else
+		f.can_mask = (0x1ffff << 8) | CAN_EFF_FLAG;
+	cfi.push_back(f);
+}
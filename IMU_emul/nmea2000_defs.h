@@ -28,6 +28,10 @@
 #ifndef NMEA2000_DEFS_H_
 #define NMEA2000_DEFS_H_
 
+#include <sys/types.h>
+#include <stdint.h>
+#include <array>
+
 class nmea2000_desc {
     public:
         const char *descr;
@@ -40,6 +44,68 @@ class nmea2000_desc {
 	virtual ~nmea2000_desc() {};
 };
 
+/*
+ * PGN -> table index lookup, built once from a fixed array of descriptors.
+ * Open addressing with linear probing in a power-of-two table at least
+ * twice the number of entries, so a lookup is one hash and a probe or two
+ * whatever the number of registered PGNs.
+ */
+template <size_t N> class nmea2000_pgn_index {
+    public:
+	inline nmea2000_pgn_index() { clear(); }
+
+	template <class T> void build(const std::array<T *, N> &descs)
+	{
+		clear();
+		for (u_int i = 0; i < N; i++) {
+			u_int h = hash(descs[i]->pgn);
+			while (table[h].index >= 0) {
+				if (table[h].pgn == descs[i]->pgn)
+					break;
+				h = (h + 1) & (tabsize - 1);
+			}
+			/* first entry wins, as with a linear scan */
+			if (table[h].index < 0) {
+				table[h].pgn = descs[i]->pgn;
+				table[h].index = i;
+			}
+		}
+	}
+
+	inline int lookup(int pgn) const
+	{
+		u_int h = hash(pgn);
+		while (table[h].index >= 0) {
+			if (table[h].pgn == pgn)
+				return table[h].index;
+			h = (h + 1) & (tabsize - 1);
+		}
+		return -1;
+	}
+
+    private:
+	static constexpr u_int log2up(size_t n, u_int b = 0)
+	    { return ((size_t)1 << b) >= n ? b : log2up(n, b + 1); }
+	static constexpr u_int tabbits = log2up(N * 2 + 2);
+	static constexpr size_t tabsize = (size_t)1 << tabbits;
+
+	struct entry {
+		int pgn;
+		int index;
+	};
+	std::array<entry, tabsize> table;
+
+	static inline u_int hash(int pgn)
+	    { return ((uint32_t)pgn * 0x9e3779b1U) >> (32 - tabbits); }
+	inline void clear()
+	    {
+		for (u_int i = 0; i < tabsize; i++) {
+			table[i].pgn = -1;
+			table[i].index = -1;
+		}
+	    }
+};
+
 #define NMEA2000_PRIORITY_HIGH          0
 #define NMEA2000_PRIORITY_SECURITY      1
 #define NMEA2000_PRIORITY_CONTROL       3
@@ -58,12 +124,17 @@ class nmea2000_desc {
 #define ISO_REQUEST		59904U
 
 #define NMEA2000_DATETIME	129033U
+#define NMEA2000_RUDDER		127245U
+#define NMEA2000_HEADING	127250U
 #define NMEA2000_ATTITUDE	127257U
 #define NMEA2000_RATEOFTURN	127251U
+#define NMEA2000_POSITION_RAPID	129025U
 #define NMEA2000_COGSOG		129026U
 #define NMEA2000_XTE		129283U
 #define NMEA2000_NAVDATA	129284U
 
+#define PRIVATE_COMMAND_STATUS	61846U	/* canbus_autopilot's status */
+
 inline double rad2deg(int rad)
 {
 	double deg;
@@ -29,20 +29,57 @@
 #define NMEA2000_FRAME_RX_H_
 #include "nmea2000_frame.h"
 #include "nmea2000_defs.h"
+#include "nmea2000_stats.h"
 #include <array>
+#include <ostream>
+#include <time.h>
 
 class nmea2000_frame_rx : public nmea2000_desc {
     public:
+	const bool fastframe;
+
 	inline nmea2000_frame_rx() :
-	    nmea2000_desc(NULL, false, -1) { enabled = false; }
+	    nmea2000_desc(NULL, false, -1), fastframe(false) { enabled = false; }
 
-	inline nmea2000_frame_rx(const char *desc, bool isuser, int pgn) :
-	    nmea2000_desc(desc, isuser, pgn) { enabled = false; }
+	inline nmea2000_frame_rx(const char *desc, bool isuser, int pgn, bool fast = false) :
+	    nmea2000_desc(desc, isuser, pgn), fastframe(fast) { enabled = false; }
 	virtual ~nmea2000_frame_rx() {};
 
 	virtual bool handle(const nmea2000_frame &) { return false;}
 };
 
+/*
+ * fast-packet PGNs: handle() gets the reassembled payload, getlen()
+ * returns the payload length. The frame is only valid during the call.
+ */
+class nmea2000_fastframe_rx : public nmea2000_frame_rx {
+    public:
+	inline nmea2000_fastframe_rx(const char *desc, bool isuser, int pgn) :
+	    nmea2000_frame_rx(desc, isuser, pgn, true) {};
+	virtual ~nmea2000_fastframe_rx() {};
+};
+
+/* canbus_autopilot's status: reports the rudder angle it drives, in % */
+typedef void (*nmea2000_command_cb)(int rudder, void *);
+
+class nmea2000_command_rx : public nmea2000_frame_rx {
+    public:
+	inline nmea2000_command_rx() :
+	    nmea2000_frame_rx("autopilot command status", true,
+	    PRIVATE_COMMAND_STATUS), cb(NULL), cbarg(NULL) {};
+	virtual ~nmea2000_command_rx() {};
+	bool handle(const nmea2000_frame &f);
+	inline void set_cb(nmea2000_command_cb c, void *a)
+	    { cb = c; cbarg = a; }
+    private:
+	nmea2000_command_cb cb;
+	void *cbarg;
+};
+
+#define NMEA2000_FAST_MAXLEN	223	/* 6 + 31 * 7 */
+#define NMEA2000_FAST_SLOTS	32
+#define NMEA2000_FAST_TIMEOUT	750	/* ms between segments */
+
 #if 0
 class nmea2000_attitude_rx : public nmea2000_frame_rx {
     public:
@@ -55,19 +92,55 @@ class nmea2000_attitude_rx : public nmea2000_frame_rx {
 
 class nmea2000_rx {
     public:
-	inline nmea2000_rx() {};
+	nmea2000_rx();
 
 	bool handle(const nmea2000_frame &);
 	const nmea2000_desc *get_byindex(u_int);
+	nmea2000_frame_rx *get_framerx(u_int);
 	int get_bypgn(int);
 	void enable(u_int, bool);
+	void print_stats(std::ostream &);
+
+	/* fast-packet reassembly */
+	struct {
+		nmea2000_counter complete;
+		nmea2000_counter lost;	/* missing or out of order segment */
+		nmea2000_counter timeout;
+		nmea2000_counter noslot;
+		nmea2000_counter bad;
+	} fast_stats;
 
     private:
+	/*
+	 * one fast packet being reassembled, keyed by src/pgn/sequence id:
+	 * a sender may interleave packets of a PGN with different ids.
+	 */
+	struct fast_slot {
+		bool inuse;
+		int src;
+		int pgn;
+		int seqid;
+		int next;	/* next expected frame counter */
+		int len;
+		int got;
+		uint32_t last;	/* ms timestamp of last segment */
+		struct can_frame hdr;
+		uint8_t data[NMEA2000_FAST_MAXLEN];
+	};
+	std::array<fast_slot, NMEA2000_FAST_SLOTS> fast_slots;
+
+	bool handle_fast(nmea2000_frame_rx *, const nmea2000_frame &);
+	fast_slot *fast_lookup(int src, int pgn, int seqid, uint32_t now);
+	fast_slot *fast_alloc(uint32_t now);
+
 	// nmea2000_attitude_rx attitude;
+	nmea2000_command_rx command;
 
-	std::array<nmea2000_frame_rx *,0> frames_rx = { {
+	std::array<nmea2000_frame_rx *,1> frames_rx = { {
 	    // &attitude,
+	    &command,
 	} };
+	nmea2000_pgn_index<1> pgn_index;
 };
 
 #endif // NMEA2000_FRAME_RX_H_
@@ -29,24 +29,70 @@
 #define NMEA2000_FRAME_TX_H_
 #include "nmea2000_frame.h"
 #include "nmea2000_defs.h"
+#include "nmea2000_fields.h"
 #include <array>
 #include <time.h>
 #include <assert.h>
+#include <sys/uio.h>
+#include <ostream>
 
 class NMEA0183;
+class nmea2000_frame_tx;
+class nmea2000_latency;
+class nmea2000_stats;
+class nmea2000_txqueue;
 
-class nmea2000_frame_tx : public nmea2000_frame, public nmea2000_desc {
+/* called before each periodic transmission, with its nominal time */
+typedef void (*nmea2000_update_cb)(nmea2000_frame_tx *,
+    const struct timespec *, void *);
+
+/* periodic transmission state of a nmea2000_frame_tx */
+struct nmea2000_sched {
+	int interval;			/* ms, 0 if not periodic */
+	struct timespec deadline;	/* absolute, CLOCK_MONOTONIC */
+	nmea2000_update_cb update;
+	void *arg;
+	unsigned long sent;
+	unsigned long missed;		/* deadlines skipped */
+	long late_max;			/* us */
+	double late_sum;		/* us */
+};
+
+#define NMEA2000_TXBATCH_MAX 64
+
+/*
+ * a set of CAN frames submitted to the socket with sendmmsg().
+ * Frames are referenced, not copied: they must stay untouched until
+ * submit() returns.
+ */
+class nmea2000_txbatch {
     public:
-	bool  valid;
+	nmea2000_txbatch();
+
+	inline void clear() { nframes = 0; }
+	inline int size() const { return nframes; }
+	inline int space() const { return NMEA2000_TXBATCH_MAX - nframes; }
+	inline const struct can_frame *get(int i) const
+	    { return (const struct can_frame *)iov[i].iov_base; }
+	bool add(const struct can_frame *);
+	int submit(int sock);
+    private:
+	int nframes;
+	struct iovec iov[NMEA2000_TXBATCH_MAX];
+	struct mmsghdr msgs[NMEA2000_TXBATCH_MAX];
+};
 
+class nmea2000_frame_tx : public nmea2000_frame, public nmea2000_desc {
+    public:
 	inline nmea2000_frame_tx() :
 	    nmea2000_frame(),
 	    nmea2000_desc(NULL, false, -1)
-	    {valid = 0; }
+	    {valid = 0; memset(&sched, 0, sizeof(sched)); }
 
 	inline nmea2000_frame_tx(const char *desc, bool isuser, u_int pgn, u_int pri, u_int len) : nmea2000_frame(), nmea2000_desc(desc, isuser, pgn)
 	    {
 		valid = 0;
+		memset(&sched, 0, sizeof(sched));
 		assert((len & 0xff) <= 8);
 		frame->can_id = ((pri & 0x7) << 26) |
 		    (pgn << 8);
@@ -56,6 +102,8 @@ class nmea2000_frame_tx : public nmea2000_frame, public nmea2000_desc {
 
 	 virtual ~nmea2000_frame_tx() {};
 
+	nmea2000_sched sched;
+
 	inline void setsrc(int src)
 	    {
 		frame->can_id = (frame->can_id & ~0xff) | (src & 0xff);
@@ -67,6 +115,15 @@ class nmea2000_frame_tx : public nmea2000_frame, public nmea2000_desc {
 	}
 
 	virtual bool send(int);
+	virtual bool queue(nmea2000_txbatch &);
+
+	/* payload written: call after each change, before sending */
+	virtual void updated() { valid = true; }
+	/* not sent any more until updated() */
+	inline void invalidate() { valid = false; }
+	inline bool isvalid() const { return valid; }
+    protected:
+	bool  valid;
 };
 
 class nmea2000_fastframe_tx : public nmea2000_frame_tx {
@@ -75,15 +132,26 @@ public:
 	inline nmea2000_fastframe_tx(const char *desc, bool isuser, u_int pgn, u_int pri, u_int len) : nmea2000_frame_tx(desc, isuser, pgn, pri, 8), fastlen(len) { init(); }
 	virtual ~nmea2000_fastframe_tx();
 	virtual bool send(int);
+	virtual bool queue(nmea2000_txbatch &);
+	/* the segments get rebuilt on next send */
+	virtual void updated() { valid = true; segvalid = false; }
 protected:
 	const int fastlen;
 private:
 	uint8_t *userdata;
 	uint8_t ident;
+	int nsegs;
+	bool segvalid;
+	struct can_frame *segs;
+	void segment();
 	inline void init()
-	    { userdata = (uint8_t *)malloc(fastlen);
+	    { userdata = (uint8_t *)calloc(1, fastlen);
 	      data = userdata; ; 
 	      ident = 0;
+	      nsegs = (fastlen <= 6) ? 1 : 1 + (fastlen - 6 + 6) / 7;
+	      assert(nsegs <= NMEA2000_TXBATCH_MAX);
+	      segs = (struct can_frame *)calloc(nsegs, sizeof(*segs));
+	      segvalid = false;
 	    }
 };
 
@@ -93,15 +161,16 @@ class iso_address_claim_tx : public nmea2000_frame_tx {
 
 	inline void setdata(u_int uniquenumn, u_int manuf, u_int devfunc, u_int devclass, u_int devinst, u_int systinst)
 	{
-	    data[0] = (uniquenumn >> 0) & 0xff;
-	    data[1] = (uniquenumn >> 8) & 0xff;
-	    data[2] = (uniquenumn >> 16) & 0x1f;
-	    data[2] |= (manuf << 5) & 0xe0;
-	    data[3] = manuf >> 3;
-	    data[4] = devinst;
-	    data[5] = devfunc;
-	    data[6] = devclass << 1;
-	    data[7] = 0x80 | (NMEA2000_INDUSTRY_GROUP << 4) | systinst;
+	    typedef iso_address_claim_pgn P;
+	    P::layout::init(data);
+	    P::uniquenumber::put_raw(data, uniquenumn);
+	    P::manufcode::put_raw(data, manuf);
+	    P::deviceinstance::put_raw(data, devinst);
+	    P::devicefunction::put_raw(data, devfunc);
+	    P::deviceclass::put_raw(data, devclass);
+	    P::systeminstance::put_raw(data, systinst);
+	    P::industrygroup::put_raw(data, NMEA2000_INDUSTRY_GROUP);
+	    P::selfconfigurable::put_raw(data, 1);
 	};
 };
 
@@ -153,9 +222,23 @@ class nmea2000_tx {
 	void enable(u_int, bool);
 
 	bool send_frame(int sock, int pgn, bool force = false);
+	bool send_frames(int sock, const int *pgns, int npgns,
+	    bool force = false);
 	void setsrc(int);
 	nmea2000_frame_tx *get_frametx(u_int);
 
+	void set_periodic(u_int, int, nmea2000_update_cb, void *);
+	void sched_start(const struct timespec *);
+	bool sched_run(int sock, bool cansend, struct timespec *next);
+	void print_sched_stats(std::ostream &);
+	bool tx_stamp(const struct can_frame *, const struct timespec *);
+	void tx_done(const struct can_frame *);
+
+	/* set by the bus */
+	nmea2000_latency *latency;
+	nmea2000_stats *stats;
+	nmea2000_txqueue *txq;	/* if NULL, send directly */
+
 	iso_address_claim_tx iso_address_claim;
 	n2k_attitude_tx n2k_attitude;
 	n2k_rateofturn_tx n2k_rateofturn;
@@ -174,7 +257,10 @@ class nmea2000_tx {
 		&n2k_xte,
 #endif
 	} };
+	nmea2000_pgn_index<3> pgn_index;
 	uint8_t sid;
+	void tx_done(const nmea2000_txbatch &, int);
+	void tx_failed(const nmea2000_txbatch &, int, int);
 };
 
 #endif // NMEA2000_FRAME_TX_H_
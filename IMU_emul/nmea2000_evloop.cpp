@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <unistd.h>
+
+#include "nmea2000_evloop.h"
+#include "simclock.h"
+
+nmea2000_evloop::nmea2000_evloop()
+{
+	running = false;
+	if (pipe(wakeup) < 0)
+		err(1, "pipe");
+	fcntl(wakeup[0], F_SETFL, fcntl(wakeup[0], F_GETFL) | O_NONBLOCK);
+	fcntl(wakeup[1], F_SETFL, fcntl(wakeup[1], F_GETFL) | O_NONBLOCK);
+}
+
+nmea2000_evloop::~nmea2000_evloop()
+{
+	close(wakeup[0]);
+	close(wakeup[1]);
+}
+
+void
+nmea2000_evloop::now(struct timespec *ts)
+{
+	simclock_now(ts);
+}
+
+void
+nmea2000_evloop::addms(struct timespec *ts, long ms)
+{
+	ts->tv_sec += ms / 1000;
+	ts->tv_nsec += (ms % 1000) * 1000000L;
+	if (ts->tv_nsec >= 1000000000L) {
+		ts->tv_sec++;
+		ts->tv_nsec -= 1000000000L;
+	}
+}
+
+bool
+nmea2000_evloop::add(int fd, bool wr, evloop_fdcb cb, void *arg)
+{
+	fdent fe;
+
+	if (fd < 0 || fd >= FD_SETSIZE)
+		return false;
+	del(fd, wr);
+	fe.fd = fd;
+	fe.wr = wr;
+	fe.cb = cb;
+	fe.arg = arg;
+	fds.push_back(fe);
+	return true;
+}
+
+void
+nmea2000_evloop::del(int fd, bool wr)
+{
+	for (size_t i = 0; i < fds.size(); i++) {
+		if (fds[i].fd == fd && fds[i].wr == wr) {
+			fds.erase(fds.begin() + i);
+			return;
+		}
+	}
+}
+
+bool
+nmea2000_evloop::add_fd(int fd, evloop_fdcb cb, void *arg)
+{
+	return add(fd, false, cb, arg);
+}
+
+void
+nmea2000_evloop::del_fd(int fd)
+{
+	del(fd, false);
+}
+
+bool
+nmea2000_evloop::add_wfd(int fd, evloop_fdcb cb, void *arg)
+{
+	return add(fd, true, cb, arg);
+}
+
+void
+nmea2000_evloop::del_wfd(int fd)
+{
+	del(fd, true);
+}
+
+int
+nmea2000_evloop::add_timer(evloop_timercb cb, void *arg)
+{
+	timerent te;
+
+	te.armed = false;
+	te.cb = cb;
+	te.arg = arg;
+	timers.push_back(te);
+	return timers.size() - 1;
+}
+
+void
+nmea2000_evloop::timer_at(int id, const struct timespec *ts)
+{
+	timers[id].when = *ts;
+	timers[id].armed = true;
+}
+
+void
+nmea2000_evloop::timer_in(int id, long ms)
+{
+	now(&timers[id].when);
+	addms(&timers[id].when, ms);
+	timers[id].armed = true;
+}
+
+void
+nmea2000_evloop::timer_stop(int id)
+{
+	timers[id].armed = false;
+}
+
+void
+nmea2000_evloop::stop(void)
+{
+	char c = 0;
+
+	running = false;
+	(void)write(wakeup[1], &c, 1);
+}
+
+/*
+ * fire expired timers; return the earliest pending deadline in next,
+ * or false if no timer is armed.
+ */
+bool
+nmea2000_evloop::run_timers(struct timespec *next)
+{
+	struct timespec ts;
+	bool pending = false;
+
+	now(&ts);
+	for (size_t i = 0; i < timers.size(); i++) {
+		if (!timers[i].armed)
+			continue;
+		if (timespeccmp(&timers[i].when, &ts, <=)) {
+			/* one-shot; the callback re-arms if needed */
+			timers[i].armed = false;
+			(*timers[i].cb)(i, timers[i].arg);
+			if (!timers[i].armed)
+				continue;
+		}
+		if (!pending || timespeccmp(&timers[i].when, next, <)) {
+			*next = timers[i].when;
+			pending = true;
+		}
+	}
+	return pending;
+}
+
+void
+nmea2000_evloop::run(void)
+{
+	fd_set read_set, write_set;
+	struct timespec next;
+	bool pending;
+	int maxfd;
+	int sret;
+	char buf[16];
+
+	running = true;
+	while (running) {
+		FD_ZERO(&read_set);
+		FD_ZERO(&write_set);
+		FD_SET(wakeup[0], &read_set);
+		maxfd = wakeup[0];
+		for (size_t i = 0; i < fds.size(); i++) {
+			FD_SET(fds[i].fd, fds[i].wr ? &write_set : &read_set);
+			if (fds[i].fd > maxfd)
+				maxfd = fds[i].fd;
+		}
+		pending = run_timers(&next);
+		sret = simclock_select(maxfd + 1, &read_set, &write_set, NULL,
+		    pending ? &next : NULL);
+		if (!running)
+			break;
+		if (sret < 0) {
+			if (errno != EINTR)
+				warn("select");
+			continue;
+		}
+		if (sret == 0)
+			continue;
+		if (FD_ISSET(wakeup[0], &read_set)) {
+			while (read(wakeup[0], buf, sizeof(buf)) > 0)
+				;
+		}
+		/* callbacks may add or remove fds: work on a copy */
+		std::vector<fdent> ready;
+		for (size_t i = 0; i < fds.size(); i++) {
+			if (FD_ISSET(fds[i].fd,
+			    fds[i].wr ? &write_set : &read_set))
+				ready.push_back(fds[i]);
+		}
+		for (size_t i = 0; i < ready.size() && running; i++)
+			(*ready[i].cb)(ready[i].fd, ready[i].arg);
+	}
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_EVLOOP_H_
+#define NMEA2000_EVLOOP_H_
+
+#include <sys/select.h>
+#include <sys/time.h>
+#include <time.h>
+#include <vector>
+
+#ifndef timespeccmp
+#define timespeccmp(tsp, usp, cmp)					\
+	(((tsp)->tv_sec == (usp)->tv_sec) ?				\
+	    ((tsp)->tv_nsec cmp (usp)->tv_nsec) :			\
+	    ((tsp)->tv_sec cmp (usp)->tv_sec))
+#endif
+#ifndef timespecsub
+#define timespecsub(tsp, usp, vsp)					\
+	do {								\
+		(vsp)->tv_sec = (tsp)->tv_sec - (usp)->tv_sec;		\
+		(vsp)->tv_nsec = (tsp)->tv_nsec - (usp)->tv_nsec;	\
+		if ((vsp)->tv_nsec < 0) {				\
+			(vsp)->tv_sec--;				\
+			(vsp)->tv_nsec += 1000000000L;			\
+		}							\
+	} while (0)
+#endif
+
+/*
+ * single-threaded event loop: file descriptors and timers on absolute
+ * simulation clock deadlines (see simclock.h), multiplexed with
+ * simclock_select(). stop() may be called from another thread or a
+ * signal handler and wakes the loop up immediately.
+ */
+typedef void (*evloop_fdcb)(int fd, void *arg);
+typedef void (*evloop_timercb)(int id, void *arg);
+
+class nmea2000_evloop {
+    public:
+	nmea2000_evloop();
+	~nmea2000_evloop();
+
+	bool add_fd(int fd, evloop_fdcb, void *);
+	void del_fd(int fd);
+	/* same, waiting for fd to be writable */
+	bool add_wfd(int fd, evloop_fdcb, void *);
+	void del_wfd(int fd);
+
+	int add_timer(evloop_timercb, void *);
+	void timer_at(int id, const struct timespec *);
+	void timer_in(int id, long ms);
+	void timer_stop(int id);
+	bool timer_armed(int id) const { return timers[id].armed; }
+
+	void run(void);
+	void stop(void);
+
+	static void now(struct timespec *);
+	static void addms(struct timespec *, long ms);
+
+    private:
+	struct fdent {
+		int fd;
+		bool wr;
+		evloop_fdcb cb;
+		void *arg;
+	};
+	struct timerent {
+		bool armed;
+		struct timespec when;
+		evloop_timercb cb;
+		void *arg;
+	};
+	std::vector<fdent> fds;
+	std::vector<timerent> timers;
+	int wakeup[2];
+	volatile bool running;
+
+	bool run_timers(struct timespec *next);
+	bool add(int fd, bool wr, evloop_fdcb, void *);
+	void del(int fd, bool wr);
+};
+
+#endif
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_FIELDS_H_
+#define NMEA2000_FIELDS_H_
+
+#include <stdint.h>
+#include <cmath>
+#include <ratio>
+#include <type_traits>
+#include "nmea2000_defs.h"
+
+/*
+ * declarative PGN payload layouts.
+ * A field is described by its bit offset and width in the (little-endian,
+ * LSB first) payload, its signedness and its resolution as a std::ratio.
+ * Everything is a template parameter: the byte loops have constant bounds
+ * and unroll, the masks and the scale factor are folded by the compiler,
+ * so put_raw()/get_raw() compile to the same code as the hand-written
+ * accessors of nmea2000_frame, bit-packed fields included.
+ */
+template <int OFF, int BITS, bool SIGNED = false, class RES = std::ratio<1> >
+struct n2k_field {
+	static_assert(OFF >= 0 && BITS > 0 && BITS <= 32, "bad field size");
+	static_assert(RES::num > 0, "bad field resolution");
+
+	typedef typename std::conditional<SIGNED, int32_t, uint32_t>::type
+	    raw_t;
+	static const int off = OFF;
+	static const int bits = BITS;
+	static const bool reserved = false;
+
+	/* bytes the field spans */
+	static const int byte = OFF / 8;
+	static const int shift = OFF % 8;
+	static const int nbytes = (shift + BITS + 7) / 8;
+
+	static constexpr uint32_t mask()
+	    { return (uint32_t)((((uint64_t)1) << BITS) - 1); }
+	/* raw units per user unit */
+	static constexpr double scale()
+	    { return (double)RES::den / (double)RES::num; }
+	/* the largest value means "data not available" */
+	static constexpr raw_t na()
+	    { return (raw_t)(SIGNED ? mask() >> 1 : mask()); }
+	/* range of the raw data values */
+	static constexpr double raw_min()
+	    { return SIGNED ? -(double)(mask() >> 1) - 1 : 0; }
+	static constexpr double raw_max()
+	    { return (double)na() - 1; }
+
+	static inline void put_raw(uint8_t *d, raw_t v)
+	{
+		uint64_t m = (uint64_t)mask() << shift;
+		uint64_t w = ((uint64_t)((uint32_t)v & mask())) << shift;
+
+		for (int i = 0; i < nbytes; i++) {
+			d[byte + i] = (d[byte + i] & ~(uint8_t)(m >> (8 * i))) |
+			    (uint8_t)(w >> (8 * i));
+		}
+	}
+
+	static inline raw_t get_raw(const uint8_t *d)
+	{
+		uint64_t w = 0;
+		uint32_t r;
+
+		for (int i = 0; i < nbytes; i++)
+			w |= (uint64_t)d[byte + i] << (8 * i);
+		r = (uint32_t)(w >> shift) & mask();
+		if (SIGNED) /* sign-extend */
+			return (raw_t)((int32_t)(r << (32 - BITS)) >> (32 - BITS));
+		return (raw_t)r;
+	}
+
+	/*
+	 * value in user units, rounded toward 0. Out of range values are
+	 * clamped to the range (without reaching the "not available" value),
+	 * NaN is sent as not available.
+	 */
+	static inline void put(uint8_t *d, double v)
+	{
+		v *= scale();
+		if (std::isnan(v))
+			put_raw(d, na());
+		else
+			put_raw(d, (raw_t)std::fmax(raw_min(),
+			    std::fmin(raw_max(), v)));
+	}
+	static inline double get(const uint8_t *d)
+	    { return get_raw(d) / scale(); }
+	static inline bool available(const uint8_t *d)
+	    { return get_raw(d) != na(); }
+	/* first byte after the field */
+	static const int end = byte + nbytes;
+};
+
+/* reserved bits, all ones unless told otherwise */
+template <int OFF, int BITS, bool ONES = true>
+struct n2k_reserved : public n2k_field<OFF, BITS> {
+	static const bool reserved = true;
+	static inline void fill(uint8_t *d)
+	    { n2k_field<OFF, BITS>::put_raw(d, ONES ? n2k_field<OFF, BITS>::mask() : 0); }
+};
+
+/*
+ * a PGN payload of LEN bytes made of the fields FS.
+ * Every bit must be described exactly once (by a field or a reserved
+ * range), this is checked at compile time.
+ */
+template <int LEN, class... FS> struct n2k_layout;
+
+template <int LEN> struct n2k_layout<LEN> {
+	static const int len = LEN;
+	static constexpr int bits() { return 0; }
+	template <class G> static constexpr bool disjoint() { return true; }
+	static constexpr bool valid() { return true; }
+	static inline void init(uint8_t *) {}
+};
+
+template <int LEN, class F, class... FS>
+struct n2k_layout<LEN, F, FS...> {
+	typedef n2k_layout<LEN, FS...> rest;
+	static const int len = LEN;
+
+	static constexpr int bits() { return F::bits + rest::bits(); }
+	/* G doesn't overlap any of our fields */
+	template <class G> static constexpr bool disjoint()
+	{
+		return (G::off + G::bits <= F::off ||
+		    F::off + F::bits <= G::off) &&
+		    rest::template disjoint<G>();
+	}
+	static constexpr bool valid()
+	{
+		return F::off + F::bits <= LEN * 8 &&
+		    rest::template disjoint<F>() && rest::valid();
+	}
+	static_assert(LEN > 0 && LEN <= 223, "bad PGN length");
+
+	/* set the reserved bits; called before the fields are put */
+	static inline void init(uint8_t *d)
+	{
+		fill<F>(d);
+		rest::init(d);
+	}
+    private:
+	template <class G> static inline
+	    typename std::enable_if<G::reserved>::type fill(uint8_t *d)
+	    { G::fill(d); }
+	template <class G> static inline
+	    typename std::enable_if<!G::reserved>::type fill(uint8_t *)
+	    { }
+};
+
+#define N2K_LAYOUT_CHECK(l) \
+	static_assert(l::valid(), #l ": overlapping or out of range fields"); \
+	static_assert(l::bits() == l::len * 8, #l ": undescribed bits")
+
+/* PGN layouts */
+
+/* ISO NAME, as sent in the address claim */
+struct iso_address_claim_pgn {
+	typedef n2k_field<0, 21>	uniquenumber;
+	typedef n2k_field<21, 11>	manufcode;
+	typedef n2k_field<32, 8>	deviceinstance;
+	typedef n2k_field<40, 8>	devicefunction;
+	typedef n2k_reserved<48, 1, false> res1;
+	typedef n2k_field<49, 7>	deviceclass;
+	typedef n2k_field<56, 4>	systeminstance;
+	typedef n2k_field<60, 3>	industrygroup;
+	typedef n2k_field<63, 1>	selfconfigurable;
+	typedef n2k_layout<8, uniquenumber, manufcode, deviceinstance,
+	    devicefunction, res1, deviceclass, systeminstance, industrygroup,
+	    selfconfigurable> layout;
+};
+N2K_LAYOUT_CHECK(iso_address_claim_pgn::layout);
+
+struct n2k_attitude_pgn {
+	typedef n2k_field<0, 8>	sid;
+	typedef n2k_field<8, 16, true, std::ratio<1, 10000> > yaw;	/* rad */
+	typedef n2k_field<24, 16, true, std::ratio<1, 10000> > pitch;
+	typedef n2k_field<40, 16, true, std::ratio<1, 10000> > roll;
+	typedef n2k_reserved<56, 8> res1;
+	typedef n2k_layout<8, sid, yaw, pitch, roll, res1> layout;
+};
+N2K_LAYOUT_CHECK(n2k_attitude_pgn::layout);
+
+struct n2k_rateofturn_pgn {
+	typedef n2k_field<0, 8>	sid;
+	typedef n2k_field<8, 32, true, std::ratio<1, 10000000> > rate;
+	typedef n2k_reserved<40, 24> res1;
+	typedef n2k_layout<8, sid, rate, res1> layout;
+};
+N2K_LAYOUT_CHECK(n2k_rateofturn_pgn::layout);
+
+struct n2k_rudder_pgn {
+	typedef n2k_field<0, 8>	instance;
+	typedef n2k_field<8, 3>	direction;
+	typedef n2k_reserved<11, 5> res1;
+	typedef n2k_field<16, 16, true, std::ratio<1, 10000> > angle_order; /* rad */
+	typedef n2k_field<32, 16, true, std::ratio<1, 10000> > position;
+	typedef n2k_reserved<48, 16> res2;
+	typedef n2k_layout<8, instance, direction, res1, angle_order,
+	    position, res2> layout;
+};
+N2K_LAYOUT_CHECK(n2k_rudder_pgn::layout);
+
+struct n2k_heading_pgn {
+	typedef n2k_field<0, 8>	sid;
+	typedef n2k_field<8, 16, false, std::ratio<1, 10000> > heading; /* rad */
+	typedef n2k_field<24, 16, true, std::ratio<1, 10000> > deviation;
+	typedef n2k_field<40, 16, true, std::ratio<1, 10000> > variation;
+	typedef n2k_field<56, 2> reference;	/* 0 true, 1 magnetic */
+	typedef n2k_reserved<58, 6> res1;
+	typedef n2k_layout<8, sid, heading, deviation, variation, reference,
+	    res1> layout;
+};
+N2K_LAYOUT_CHECK(n2k_heading_pgn::layout);
+
+struct n2k_position_rapid_pgn {
+	typedef n2k_field<0, 32, true, std::ratio<1, 10000000> > latitude; /* deg */
+	typedef n2k_field<32, 32, true, std::ratio<1, 10000000> > longitude;
+	typedef n2k_layout<8, latitude, longitude> layout;
+};
+N2K_LAYOUT_CHECK(n2k_position_rapid_pgn::layout);
+
+struct n2k_cogsog_pgn {
+	typedef n2k_field<0, 8>	sid;
+	typedef n2k_field<8, 2>	reference;
+	typedef n2k_reserved<10, 6> res1;
+	typedef n2k_field<16, 16, false, std::ratio<1, 10000> > cog; /* rad */
+	typedef n2k_field<32, 16, false, std::ratio<1, 100> > sog; /* m/s */
+	typedef n2k_reserved<48, 16> res2;
+	typedef n2k_layout<8, sid, reference, res1, cog, sog, res2> layout;
+};
+N2K_LAYOUT_CHECK(n2k_cogsog_pgn::layout);
+
+struct n2k_xte_pgn {
+	typedef n2k_field<0, 8>	sid;
+	typedef n2k_field<8, 4>	mode;
+	typedef n2k_reserved<12, 2> res1;
+	typedef n2k_field<14, 2> navterminated;
+	typedef n2k_field<16, 32, true, std::ratio<1, 100> > xte; /* m */
+	typedef n2k_reserved<48, 16> res2;
+	typedef n2k_layout<8, sid, mode, res1, navterminated, xte, res2> layout;
+};
+N2K_LAYOUT_CHECK(n2k_xte_pgn::layout);
+
+/* fast packet */
+struct n2k_navdata_pgn {
+	typedef n2k_field<0, 8>	sid;
+	typedef n2k_field<8, 32, false, std::ratio<1, 100> > distance; /* m */
+	typedef n2k_field<40, 2> bearing_ref;
+	typedef n2k_field<42, 2> perpendicular;
+	typedef n2k_field<44, 2> arrived;
+	typedef n2k_field<46, 2> calc_type;
+	typedef n2k_field<48, 32, false, std::ratio<1, 10000> > eta_time; /* s */
+	typedef n2k_field<80, 16> eta_date;	/* days since 1970 */
+	typedef n2k_field<96, 16, false, std::ratio<1, 10000> > bearing_orig; /* rad */
+	typedef n2k_field<112, 16, false, std::ratio<1, 10000> > bearing_pos;
+	typedef n2k_field<128, 32> orig_wp;
+	typedef n2k_field<160, 32> dest_wp;
+	typedef n2k_field<192, 32, true, std::ratio<1, 10000000> > dest_lat; /* deg */
+	typedef n2k_field<224, 32, true, std::ratio<1, 10000000> > dest_lon;
+	typedef n2k_field<256, 16, true, std::ratio<1, 100> > closing_speed; /* m/s */
+	typedef n2k_layout<34, sid, distance, bearing_ref, perpendicular,
+	    arrived, calc_type, eta_time, eta_date, bearing_orig, bearing_pos,
+	    orig_wp, dest_wp, dest_lat, dest_lon, closing_speed> layout;
+};
+N2K_LAYOUT_CHECK(n2k_navdata_pgn::layout);
+
+#endif /* NMEA2000_FIELDS_H_ */
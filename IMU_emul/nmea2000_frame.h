@@ -30,6 +30,7 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
 #include <sys/socket.h>
 #ifdef __NetBSD__
 #include <netcan/can.h>
@@ -43,7 +44,10 @@ class nmea2000_frame {
     public:
 	inline nmea2000_frame() {init();}
 	inline nmea2000_frame(struct can_frame *f)
-	    { frame  = f; data = f->data;}
+	    { frame  = f; data = f->data; clrtstamp();}
+	/* header from f, payload (getlen() bytes) from d */
+	inline nmea2000_frame(struct can_frame *f, uint8_t *d)
+	    { frame  = f; data = d; clrtstamp();}
 	virtual ~nmea2000_frame() {};
 	inline bool is_pdu1() const
 	    { return (((frame->can_id >> 16) & 0xff) < 240); };
@@ -57,6 +61,13 @@ class nmea2000_frame {
 	inline int getpri() const { return ((frame->can_id >> 26) & 0x7); };
 	inline int getlen() const { return (frame->can_dlc); };
 	inline const unsigned char *getdata() const {return (data); };
+	inline const struct can_frame *getframe() const {return (frame); };
+	/* time the frame was received or sent, CLOCK_REALTIME; NULL if unknown */
+	inline const struct timespec *gettstamp() const
+	    { return (tstamp.tv_sec == 0 && tstamp.tv_nsec == 0) ? NULL : &tstamp; }
+	inline void settstamp(const struct timespec *ts)
+	    { if (ts != NULL) tstamp = *ts; else clrtstamp(); }
+	inline void clrtstamp() { tstamp.tv_sec = 0; tstamp.tv_nsec = 0; }
 	inline ssize_t readframe(int s) {
 	    return read(s, frame, sizeof(struct can_frame));
 	}
@@ -124,12 +135,14 @@ class nmea2000_frame {
     protected:
 	struct can_frame *frame;
 	uint8_t *data;
+	struct timespec tstamp;
     private:
 	struct can_frame _frame;
 	inline void init() 
 	    { frame = &_frame;
 	      memset(frame, 0, sizeof(struct can_frame));
 	      data = frame->data;
+	      clrtstamp();
 	    }
 };
 
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <err.h>
+#include <errno.h>
+
+#include <iostream>
+#include "nmea2000_loadgen.h"
+#include "nmea2000_evloop.h"
+
+nmea2000_loadgen::nmea2000_loadgen(double u, int br)
+{
+	util = u;
+	bitrate = br;
+	totalweight = 0;
+	maxunit = 1;
+}
+
+nmea2000_loadgen::~nmea2000_loadgen()
+{
+	for (size_t i = 0; i < mix.size(); i++)
+		delete mix[i].f;
+}
+
+/*
+ * add a PGN to the mix; spec is pgn:len:pri:src[:weight]. PGNs longer
+ * than 8 bytes are sent as fast packets.
+ */
+bool nmea2000_loadgen::add(const char *spec)
+{
+	u_int pgn, len, pri, src, weight = 1;
+	entry e;
+
+	if (sscanf(spec, "%u:%u:%u:%u:%u", &pgn, &len, &pri, &src, &weight) < 4)
+		return false;
+	if (pgn > 0x1ffff || len == 0 || len > 223 || pri > 7 ||
+	    src >= NMEA2000_ADDR_NULL || weight == 0)
+		return false;
+	if (len > 8)
+		e.f = new nmea2000_fastframe_tx("load", false, pgn, pri, len);
+	else
+		e.f = new nmea2000_frame_tx("load", false, pgn, pri, len);
+	e.f->setsrc(src);
+	if (e.f->is_pdu1())
+		e.f->setdst(NMEA2000_ADDR_GLOBAL);
+	e.f->updated();
+	e.len = len;
+	if (len > 8 && (int)(len + 7) / 7 > maxunit)
+		maxunit = (len + 7) / 7;
+	e.weight = weight;
+	e.current = 0;
+	e.count = 0;
+	mix.push_back(e);
+	totalweight += weight;
+	return true;
+}
+
+/* smooth weighted round robin: deterministic, and no bursts of one PGN */
+nmea2000_loadgen::entry *nmea2000_loadgen::next(void)
+{
+	entry *best = NULL;
+
+	for (size_t i = 0; i < mix.size(); i++) {
+		mix[i].current += mix[i].weight;
+		if (best == NULL || mix[i].current > best->current)
+			best = &mix[i];
+	}
+	best->current -= totalweight;
+	return best;
+}
+
+/*
+ * number of bits of a CAN 2.0B extended data frame on the wire: the
+ * stuffed part (SOF to CRC), then CRC delimiter, ACK, EOF and
+ * intermission.
+ */
+int nmea2000_loadgen::frame_bits(const struct can_frame *cf)
+{
+	uint8_t bits[160];
+	uint32_t id = cf->can_id & CAN_EFF_MASK;
+	int dlc = cf->can_dlc > 8 ? 8 : cf->can_dlc;
+	int n = 0, i;
+	int crc = 0, stuff = 0, run;
+	uint8_t prev;
+
+#define PUTBITS(v, w) for (i = (w) - 1; i >= 0; i--) bits[n++] = ((v) >> i) & 1
+	PUTBITS(0, 1);			/* SOF */
+	PUTBITS(id >> 18, 11);		/* base id */
+	PUTBITS(1, 1);			/* SRR */
+	PUTBITS(1, 1);			/* IDE */
+	PUTBITS(id & 0x3ffff, 18);	/* extended id */
+	PUTBITS(0, 1);			/* RTR */
+	PUTBITS(0, 2);			/* r1, r0 */
+	PUTBITS(dlc, 4);
+	for (int b = 0; b < dlc; b++) {
+		PUTBITS(cf->data[b], 8);
+	}
+	for (int b = 0; b < n; b++) {
+		int nxt = bits[b] ^ ((crc >> 14) & 1);
+		crc = (crc << 1) & 0x7fff;
+		if (nxt)
+			crc ^= 0x4599;
+	}
+	PUTBITS(crc, 15);
+#undef PUTBITS
+
+	prev = bits[0];
+	run = 1;
+	for (i = 1; i < n; i++) {
+		if (bits[i] == prev) {
+			run++;
+		} else {
+			prev = bits[i];
+			run = 1;
+		}
+		if (run == 5) {
+			/* the stuff bit starts a new run */
+			stuff++;
+			prev = !prev;
+			run = 1;
+		}
+	}
+	return n + stuff + 13;
+}
+
+/*
+ * send forever. Frame k is due when the bits of the frames before it,
+ * at the target rate, fill the time since start: late frames go out
+ * together in one batch, early ones wait on an absolute deadline.
+ * This is bus time, so it always runs on the real clock.
+ */
+void nmea2000_loadgen::run(int sock, std::ostream &report)
+{
+	nmea2000_txbatch batch;
+	struct timespec t0, now, due, el;
+	double rate = util * bitrate;
+	double elapsed;
+	uint64_t sent_bits = 0, sent_frames = 0;
+	uint64_t last_bits = 0, last_frames = 0;
+	double last_report = 0;
+	int batch_bits[NMEA2000_TXBATCH_MAX];
+	uint32_t seq = 0;
+
+	if (mix.empty() || rate <= 0)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while (1) {
+		double due_s = sent_bits / rate;
+		due = t0;
+		due.tv_sec += (time_t)due_s;
+		due.tv_nsec += (long)((due_s - (time_t)due_s) * 1e9);
+		if (due.tv_nsec >= 1000000000L) {
+			due.tv_sec++;
+			due.tv_nsec -= 1000000000L;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+		    &due, NULL) == EINTR)
+			;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		timespecsub(&now, &t0, &el);
+		elapsed = el.tv_sec + el.tv_nsec / 1e9;
+
+		/* queue everything that is due, at least one PGN */
+		batch.clear();
+		uint64_t queued_bits = 0;
+		do {
+			entry *e = next();
+			int first = batch.size();
+
+			/* change the payload, for realistic stuffing */
+			e->count++;
+			seq++;
+			memcpy((uint8_t *)e->f->getdata(), &seq,
+			    e->len < sizeof(seq) ? e->len : sizeof(seq));
+			e->f->updated();
+			if (!e->f->queue(batch))
+				break;
+			for (int i = first; i < batch.size(); i++) {
+				batch_bits[i] = frame_bits(batch.get(i));
+				queued_bits += batch_bits[i];
+			}
+		} while (batch.space() >= maxunit &&
+		    sent_bits + queued_bits < elapsed * rate);
+
+		int sent = batch.submit(sock);
+		if (sent < batch.size())
+			warn("send load batch (%d/%d)", sent, batch.size());
+		for (int i = 0; i < sent; i++)
+			sent_bits += batch_bits[i];
+		sent_frames += sent;
+		if (sent == 0)
+			usleep(1000);
+
+		if (elapsed - last_report >= 1.0) {
+			double dt = elapsed - last_report;
+			report << "frames/s " << (sent_frames - last_frames) / dt
+			    << " bits/s " << (sent_bits - last_bits) / dt
+			    << " load " << (sent_bits - last_bits) / dt / bitrate * 100
+			    << "% pacing error "
+			    << (sent_bits - elapsed * rate) / (elapsed * rate) * 100
+			    << "%" << std::endl;
+			last_report = elapsed;
+			last_bits = sent_bits;
+			last_frames = sent_frames;
+		}
+	}
+}
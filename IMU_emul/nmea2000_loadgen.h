@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_LOADGEN_H_
+#define NMEA2000_LOADGEN_H_
+
+#include <vector>
+#include <ostream>
+#include "nmea2000_defs_tx.h"
+
+/*
+ * bus load generator: sends a weighted mix of PGNs, paced so that the
+ * frames take the requested share of the bus bandwidth. Frame sizes are
+ * computed from the real CAN bit layout, including stuff bits.
+ */
+class nmea2000_loadgen {
+    public:
+	nmea2000_loadgen(double util, int bitrate = 250000);
+	~nmea2000_loadgen();
+
+	bool add(const char *spec);
+	void run(int sock, std::ostream &report);
+
+	static int frame_bits(const struct can_frame *);
+
+    private:
+	struct entry {
+		nmea2000_frame_tx *f;
+		u_int len;
+		int weight;
+		int current;
+		uint32_t count;
+	};
+	std::vector<entry> mix;
+	int totalweight;
+	int maxunit;	/* max number of CAN frames for one PGN */
+	double util;
+	int bitrate;
+
+	entry *next(void);
+};
+
+#endif
@@ -32,7 +32,10 @@
 void
 n2k_rateofturn_tx::update(double rot, uint8_t sid)
 {
-	uint82frame(sid, 0);
-	int322frame(rot * 1000 * 10000, 1);
-	valid = true;
+	typedef n2k_rateofturn_pgn P;
+
+	P::layout::init(data);
+	P::sid::put_raw(data, sid);
+	P::rate::put(data, rot);
+	updated();
 }
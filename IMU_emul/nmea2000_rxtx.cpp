@@ -26,23 +26,158 @@
  */
 
 #include <err.h>
+#include <errno.h>
 #include <iostream>
 #include "NMEA2000.h"
+#include "nmea2000_evloop.h"
 #include "nmea2000_defs_tx.h"
 #include "nmea2000_defs_rx.h"
+#include "nmea2000_tstamp.h"
+#include "nmea2000_stats.h"
+#include "nmea2000_txqueue.h"
+
+nmea2000_rx::nmea2000_rx()
+{
+	pgn_index.build(frames_rx);
+	for (u_int i = 0; i < fast_slots.size(); i++)
+		fast_slots[i].inuse = false;
+}
 
 bool nmea2000_rx::handle(const nmea2000_frame &n2kf)
 {
+	int i = pgn_index.lookup(n2kf.getpgn());
+
+	if (i < 0 || !frames_rx[i]->enabled)
+		return false;
+	if (frames_rx[i]->fastframe)
+		return handle_fast(frames_rx[i], n2kf);
+	return frames_rx[i]->handle(n2kf);
+}
+
+static uint32_t
+mstime(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* find the slot for src/pgn/seqid; a slot idle for too long is freed */
+nmea2000_rx::fast_slot *nmea2000_rx::fast_lookup(int src, int pgn, int seqid,
+    uint32_t now)
+{
+	for (u_int i = 0; i < fast_slots.size(); i++) {
+		fast_slot *fs = &fast_slots[i];
+		if (!fs->inuse || fs->src != src || fs->pgn != pgn ||
+		    fs->seqid != seqid)
+			continue;
+		if (now - fs->last > NMEA2000_FAST_TIMEOUT) {
+			fs->inuse = false;
+			fast_stats.timeout++;
+			return NULL;
+		}
+		return fs;
+	}
+	return NULL;
+}
+
+nmea2000_rx::fast_slot *nmea2000_rx::fast_alloc(uint32_t now)
+{
+	fast_slot *fs = NULL;
+
+	for (u_int i = 0; i < fast_slots.size(); i++) {
+		if (fast_slots[i].inuse &&
+		    now - fast_slots[i].last > NMEA2000_FAST_TIMEOUT) {
+			fast_slots[i].inuse = false;
+			fast_stats.timeout++;
+		}
+		if (!fast_slots[i].inuse && fs == NULL)
+			fs = &fast_slots[i];
+	}
+	if (fs == NULL)
+		fast_stats.noslot++;
+	return fs;
+}
+
+bool nmea2000_rx::handle_fast(nmea2000_frame_rx *rx, const nmea2000_frame &n2kf)
+{
+	int src = n2kf.getsrc();
 	int pgn = n2kf.getpgn();
+	int dlc = n2kf.getlen();
+	const uint8_t *d = n2kf.getdata();
+	uint32_t now;
+	fast_slot *fs;
+	int seqid, cnt, l;
+
+	if (dlc < 2 || dlc > 8) {
+		fast_stats.bad++;
+		return false;
+	}
+	seqid = d[0] >> 5;
+	cnt = d[0] & 0x1f;
+	now = mstime();
+	fs = fast_lookup(src, pgn, seqid, now);
 
-	for (u_int i = 0; i < frames_rx.size(); i++) {
-		if (frames_rx[i]->pgn == pgn) {
-			if (frames_rx[i]->enabled)
-				return frames_rx[i]->handle(n2kf);
+	if (cnt == 0) {
+		if (fs != NULL) {
+			/* previous packet with this id never completed */
+			fast_stats.lost++;
+			fs->inuse = false;
+		}
+		if (d[1] == 0 || d[1] > NMEA2000_FAST_MAXLEN) {
+			fast_stats.bad++;
 			return false;
 		}
+		if ((fs = fast_alloc(now)) == NULL)
+			return false;
+		fs->inuse = true;
+		fs->src = src;
+		fs->pgn = pgn;
+		fs->seqid = seqid;
+		fs->next = 1;
+		fs->len = d[1];
+		fs->hdr = *n2kf.getframe();
+		l = fs->len < 6 ? fs->len : 6;
+		if (l > dlc - 2)
+			l = dlc - 2;
+		memcpy(fs->data, &d[2], l);
+		fs->got = l;
+	} else {
+		if (fs == NULL) {
+			/* start of packet missed */
+			fast_stats.lost++;
+			return false;
+		}
+		if (fs->next != cnt) {
+			fast_stats.lost++;
+			fs->inuse = false;
+			return false;
+		}
+		l = fs->len - fs->got;
+		if (l > dlc - 1)
+			l = dlc - 1;
+		memcpy(&fs->data[fs->got], &d[1], l);
+		fs->got += l;
+		fs->next++;
 	}
-	return false;
+	fs->last = now;
+	if (fs->got < fs->len)
+		return true;
+
+	fs->hdr.can_dlc = fs->len;
+	nmea2000_frame fast(&fs->hdr, fs->data);
+	fast.settstamp(n2kf.gettstamp());
+	fs->inuse = false;
+	fast_stats.complete++;
+	return rx->handle(fast);
+}
+
+void nmea2000_rx::print_stats(std::ostream &os)
+{
+	os << "fast packets: " << fast_stats.complete << " complete, "
+	    << fast_stats.lost << " lost segments, " << fast_stats.timeout << " timeouts, "
+	    << fast_stats.noslot << " no slot, " << fast_stats.bad << " bad" << std::endl;
 }
 
 const nmea2000_desc * nmea2000_rx::get_byindex(u_int i) {
@@ -52,13 +187,15 @@ const nmea2000_desc * nmea2000_rx::get_byindex(u_int i) {
 	return frames_rx[i];
 }
 
-int nmea2000_rx::get_bypgn(int pgn) {
-	for (u_int i = 0; i < frames_rx.size(); i++) {
-		if (frames_rx[i]->pgn == pgn) {
-			return i;
-		}
+nmea2000_frame_rx * nmea2000_rx::get_framerx(u_int i) {
+	if (i >= frames_rx.size()) {
+		return NULL;
 	}
-	return -1;
+	return frames_rx[i];
+}
+
+int nmea2000_rx::get_bypgn(int pgn) {
+	return pgn_index.lookup(pgn);
 }
 
 void nmea2000_rx::enable(u_int i, bool en)
@@ -71,6 +208,10 @@ void nmea2000_rx::enable(u_int i, bool en)
 nmea2000_tx::nmea2000_tx()
 {
 	sid = 0;
+	latency = NULL;
+	stats = NULL;
+	txq = NULL;
+	pgn_index.build(frames_tx);
 };
 
 nmea2000_tx::~nmea2000_tx()
@@ -92,12 +233,7 @@ nmea2000_frame_tx *nmea2000_tx::get_frametx(u_int i) {
 }
 
 int nmea2000_tx::get_bypgn(int pgn) {
-	for (u_int i = 0; i < frames_tx.size(); i++) {
-		if (frames_tx[i]->pgn == pgn) {
-			return i;
-		}
-	}
-	return -1;
+	return pgn_index.lookup(pgn);
 }
 
 void nmea2000_tx::enable(u_int i, bool en)
@@ -108,16 +244,198 @@ void nmea2000_tx::enable(u_int i, bool en)
 }
 
 bool nmea2000_tx::send_frame(int sock, int pgn, bool force) {
+	return send_frames(sock, &pgn, 1, force);
+}
+
+bool nmea2000_tx::send_frames(int sock, const int *pgns, int npgns, bool force)
+{
+	nmea2000_txbatch batch;
+	bool ret = true;
+	int sent, before;
+
+	for (int j = 0; j < npgns; j++) {
+		int i = pgn_index.lookup(pgns[j]);
+		if (i < 0 || !(frames_tx[i]->enabled || force)) {
+			ret = false;
+			continue;
+		}
+		before = batch.size();
+		if (!frames_tx[i]->queue(batch))
+			ret = false;
+		else if (txq != NULL &&
+		    !txq->enqueue(batch, before, batch.size(), false))
+			ret = false;
+	}
+	if (batch.size() == 0)
+		return false;
+	if (txq != NULL) {
+		txq->flush();
+		return ret;
+	}
+	sent = batch.submit(sock);
+	tx_done(batch, sent);
+	if (sent < batch.size()) {
+		tx_failed(batch, sent, errno);
+		warn("send batch (%d/%d)", sent, batch.size());
+		return false;
+	}
+	return ret;
+}
+
+void nmea2000_tx::set_periodic(u_int i, int interval, nmea2000_update_cb cb, void *arg)
+{
+	if (i >= frames_tx.size())
+		return;
+	frames_tx[i]->sched.interval = interval;
+	frames_tx[i]->sched.update = cb;
+	frames_tx[i]->sched.arg = arg;
+}
+
+/*
+ * (re)start the schedule at now. The first deadlines of the periodic
+ * PGNs are spread over their interval, so that they don't all go out
+ * in the same burst.
+ */
+void nmea2000_tx::sched_start(const struct timespec *now)
+{
+	int n = 0, k = 0;
+
 	for (u_int i = 0; i < frames_tx.size(); i++) {
-		if (frames_tx[i]->pgn == pgn) {
-			if (frames_tx[i]->enabled || force) {
-				return frames_tx[i]->send(sock);
-			} else {
-				return false;
+		if (frames_tx[i]->sched.interval > 0)
+			n++;
+	}
+	for (u_int i = 0; i < frames_tx.size(); i++) {
+		nmea2000_sched *s = &frames_tx[i]->sched;
+		if (s->interval <= 0)
+			continue;
+		s->deadline = *now;
+		nmea2000_evloop::addms(&s->deadline, (long)s->interval * k / n);
+		k++;
+	}
+}
+
+/*
+ * send the periodic PGNs whose deadline has passed, all in one batch.
+ * Deadlines advance by whole intervals from the previous deadline, so
+ * a late run doesn't shift the schedule; intervals entirely missed are
+ * skipped and counted. Returns the next deadline in next, or false if
+ * nothing is periodic.
+ */
+bool nmea2000_tx::sched_run(int sock, bool cansend, struct timespec *next)
+{
+	nmea2000_txbatch batch;
+	struct timespec now, late;
+	bool pending = false;
+	long late_us;
+	int before;
+
+	nmea2000_evloop::now(&now);
+	for (u_int i = 0; i < frames_tx.size(); i++) {
+		nmea2000_frame_tx *f = frames_tx[i];
+		nmea2000_sched *s = &f->sched;
+		if (s->interval <= 0)
+			continue;
+		if (timespeccmp(&s->deadline, &now, <=)) {
+			timespecsub(&now, &s->deadline, &late);
+			late_us = late.tv_sec * 1000000L + late.tv_nsec / 1000;
+			while (late_us >= s->interval * 1000L) {
+				nmea2000_evloop::addms(&s->deadline, s->interval);
+				late_us -= s->interval * 1000L;
+				s->missed++;
+			}
+			if (s->update != NULL)
+				(*s->update)(f, &s->deadline, s->arg);
+			before = batch.size();
+			if (cansend && f->enabled && f->queue(batch) &&
+			    (txq == NULL ||
+			    txq->enqueue(batch, before, batch.size(), true))) {
+				s->sent++;
+				s->late_sum += late_us;
+				if (late_us > s->late_max)
+					s->late_max = late_us;
 			}
+			nmea2000_evloop::addms(&s->deadline, s->interval);
+		}
+		if (!pending || timespeccmp(&s->deadline, next, <)) {
+			*next = s->deadline;
+			pending = true;
+		}
+	}
+	if (batch.size() > 0 && txq != NULL) {
+		txq->flush();
+	} else if (batch.size() > 0) {
+		int sent = batch.submit(sock);
+		tx_done(batch, sent);
+		if (sent < batch.size()) {
+			tx_failed(batch, sent, errno);
+			warn("send periodic batch");
 		}
 	}
-	return false;
+	return pending;
+}
+
+void nmea2000_tx::print_sched_stats(std::ostream &os)
+{
+	for (u_int i = 0; i < frames_tx.size(); i++) {
+		nmea2000_sched *s = &frames_tx[i]->sched;
+		if (s->interval <= 0)
+			continue;
+		os << frames_tx[i]->descr << ": every " << s->interval
+		    << "ms, " << s->sent << " sent, " << s->missed << " missed";
+		if (s->sent > 0) {
+			os << ", late avg " << s->late_sum / s->sent
+			    << "us max " << s->late_max << "us";
+		}
+		os << std::endl;
+	}
+}
+
+/*
+ * a frame of ours went out at ts: keep it in the nmea2000_frame_tx.
+ * Returns false if it's not one of ours.
+ */
+bool nmea2000_tx::tx_stamp(const struct can_frame *cf, const struct timespec *ts)
+{
+	nmea2000_frame f((struct can_frame *)(uintptr_t)cf);
+	int i = pgn_index.lookup(f.getpgn());
+
+	if (i < 0 || frames_tx[i]->getframe()->can_id != cf->can_id)
+		return false;
+	frames_tx[i]->settstamp(ts);
+	return true;
+}
+
+/*
+ * frames just sent: count them, and take userland timestamps if the
+ * kernel doesn't
+ */
+void nmea2000_tx::tx_done(const struct can_frame *cf)
+{
+	nmea2000_frame f((struct can_frame *)(uintptr_t)cf);
+	struct timespec now;
+
+	if (stats != NULL)
+		stats->tx(cf);
+	if (latency == NULL || latency->kernel_tx || latency->size() == 0)
+		return;
+	clock_gettime(CLOCK_REALTIME, &now);
+	tx_stamp(cf, &now);
+	latency->response(f.getpgn(), &now);
+}
+
+void nmea2000_tx::tx_done(const nmea2000_txbatch &batch, int sent)
+{
+	for (int i = 0; i < sent; i++)
+		tx_done(batch.get(i));
+}
+
+/* the frames of batch from sent on didn't go out */
+void nmea2000_tx::tx_failed(const nmea2000_txbatch &batch, int sent, int err)
+{
+	if (stats == NULL)
+		return;
+	for (int i = sent; i < batch.size(); i++)
+		stats->tx_error(batch.get(i), err);
 }
 
 void nmea2000_tx::setsrc(int src) {
@@ -137,38 +455,121 @@ bool nmea2000_frame_tx::send(int sock) {
 	return true;
 }
 
+bool nmea2000_frame_tx::queue(nmea2000_txbatch &batch) {
+	if (!valid)
+		return false;
+	return batch.add(frame);
+}
+
 nmea2000_fastframe_tx::~nmea2000_fastframe_tx()
 {
+	free(segs);
 	free(userdata);
 }
 
 bool nmea2000_fastframe_tx::send(int sock)
+{
+	nmea2000_txbatch batch;
+	int sent;
+
+	if (!queue(batch))
+		return false;
+	sent = batch.submit(sock);
+	if (sent < batch.size()) {
+		warn("send %s (%d)", descr, sent);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * split the payload into its fast-packet segments. The segments are kept
+ * until the payload (see updated()) or the CAN id change, only the
+ * sequence id is patched on each send.
+ */
+void nmea2000_fastframe_tx::segment()
 {
 	int i;
 	int n;
-	if (!valid)
-		return false;
 
 	for (i = 0, n = 0; i < fastlen; n++) {
-		frame->data[0] = (ident << 5) | n ;
+		struct can_frame *seg = &segs[n];
+		seg->can_id = frame->can_id;
+		seg->data[0] = n;
 		if (n == 0) {
-			frame->data[1] = fastlen;
-			memcpy(&frame->data[2], &data[i], 6);
+			seg->data[1] = fastlen;
+			memcpy(&seg->data[2], &data[i], 6);
 			i += 6;
-			frame->can_dlc = 8;
+			seg->can_dlc = 8;
 		} else {
 			int remain = fastlen - i;
 			if (remain > 7)
 				remain = 7;
-			memcpy(&frame->data[1], &data[i], remain);
-			frame->can_dlc = remain + 1;
+			memcpy(&seg->data[1], &data[i], remain);
+			seg->can_dlc = remain + 1;
 			i += remain;
 		}
-		if (write(sock, frame, sizeof(struct can_frame)) < 0) {
-			warn("send %s (%d)", descr, n);
-			return false;
-		}
+	}
+	segvalid = true;
+}
+
+bool nmea2000_fastframe_tx::queue(nmea2000_txbatch &batch)
+{
+	if (!valid)
+		return false;
+	if (batch.space() < nsegs)
+		return false;
+
+	if (!segvalid || segs[0].can_id != frame->can_id)
+		segment();
+	for (int n = 0; n < nsegs; n++) {
+		segs[n].data[0] = (ident << 5) | n;
+		batch.add(&segs[n]);
 	}
 	ident = (ident + 1) & 0x7;
 	return true;
 }
+
+nmea2000_txbatch::nmea2000_txbatch()
+{
+	nframes = 0;
+	memset(msgs, 0, sizeof(msgs));
+	for (int i = 0; i < NMEA2000_TXBATCH_MAX; i++) {
+		iov[i].iov_len = sizeof(struct can_frame);
+		msgs[i].msg_hdr.msg_iov = &iov[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+}
+
+bool nmea2000_txbatch::add(const struct can_frame *f)
+{
+	if (nframes >= NMEA2000_TXBATCH_MAX)
+		return false;
+	iov[nframes].iov_base = (void *)(uintptr_t)f;
+	nframes++;
+	return true;
+}
+
+/*
+ * send the whole batch; sendmmsg() may stop early, so resubmit the rest
+ * until everything is sent or an error occurs. Returns the number of
+ * frames actually sent, in order.
+ */
+int nmea2000_txbatch::submit(int sock)
+{
+	int sent = 0;
+	int r;
+
+	while (sent < nframes) {
+		r = sendmmsg(sock, &msgs[sent], nframes - sent, 0);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (r == 0)
+			break;
+		sent += r;
+	}
+	return sent;
+}
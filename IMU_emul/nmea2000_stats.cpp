@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include "nmea2000_frame.h"
+#include "nmea2000_evloop.h"
+#include "nmea2000_stats.h"
+
+nmea2000_stats::nmea2000_stats()
+{
+	for (int i = 0; i < NMEA2000_STATS_PGNS; i++)
+		pgns[i].pgn.store(-2, std::memory_order_relaxed);
+	pgn_other.pgn.store(-1, std::memory_order_relaxed);
+	timing = false;
+}
+
+nmea2000_stats::pgn_counters *
+nmea2000_stats::lookup(int pgn)
+{
+	static_assert(NMEA2000_STATS_PGNS == 256, "fix the hash");
+	u_int h = ((uint32_t)pgn * 0x9e3779b1U) >> 24;
+	int p;
+
+	for (int n = 0; n < NMEA2000_STATS_PGNS; n++) {
+		pgn_counters *c = &pgns[(h + n) & (NMEA2000_STATS_PGNS - 1)];
+		p = c->pgn.load(std::memory_order_acquire);
+		if (p == -2) {
+			if (c->pgn.compare_exchange_strong(p, pgn,
+			    std::memory_order_acq_rel))
+				return c;
+			/* lost the race, p is the winner's PGN */
+		}
+		if (p == pgn)
+			return c;
+	}
+	return &pgn_other;
+}
+
+void
+nmea2000_stats::rx(const struct can_frame *cf)
+{
+	nmea2000_frame f((struct can_frame *)(uintptr_t)cf);
+	pgn_counters *c = lookup(f.getpgn());
+
+	c->rx_frames++;
+	c->rx_bytes.add(cf->can_dlc);
+	srcs[f.getsrc()].rx_frames++;
+	srcs[f.getsrc()].rx_bytes.add(cf->can_dlc);
+}
+
+void
+nmea2000_stats::rx_time(int pgn, unsigned long ns)
+{
+	lookup(pgn)->rx_ns.add(ns);
+}
+
+void
+nmea2000_stats::tx(const struct can_frame *cf)
+{
+	nmea2000_frame f((struct can_frame *)(uintptr_t)cf);
+	pgn_counters *c = lookup(f.getpgn());
+
+	c->tx_frames++;
+	c->tx_bytes.add(cf->can_dlc);
+}
+
+void
+nmea2000_stats::tx_error(const struct can_frame *cf, int e)
+{
+	nmea2000_frame f((struct can_frame *)(uintptr_t)cf);
+
+	lookup(f.getpgn())->tx_errors++;
+	if (e < 0 || e >= NMEA2000_STATS_ERRNO)
+		e = 0;
+	tx_errno[e]++;
+}
+
+/* ask the kernel for the number of frames dropped on a full socket */
+bool
+nmea2000_stats::rxq_ovfl_enable(int sock)
+{
+#ifdef SO_RXQ_OVFL
+	int on = 1;
+
+	return (setsockopt(sock, SOL_SOCKET, SO_RXQ_OVFL,
+	    &on, sizeof(on)) == 0);
+#else
+	return false;
+#endif
+}
+
+bool
+nmea2000_stats::rxq_ovfl_get(struct msghdr *msg, uint32_t *drops)
+{
+#ifdef SO_RXQ_OVFL
+	struct cmsghdr *cm;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+		if (cm->cmsg_level == SOL_SOCKET &&
+		    cm->cmsg_type == SO_RXQ_OVFL) {
+			memcpy(drops, CMSG_DATA(cm), sizeof(*drops));
+			return true;
+		}
+	}
+#endif
+	return false;
+}
+
+static void
+metric_head(std::ostream &os, const char *name, const char *type,
+    const char *help)
+{
+	os << "# HELP " << name << " " << help << std::endl;
+	os << "# TYPE " << name << " " << type << std::endl;
+}
+
+/* Prometheus text exposition format */
+void
+nmea2000_stats::print(std::ostream &os) const
+{
+	static const struct {
+		const char *name;
+		const char *help;
+		nmea2000_counter pgn_counters::*c;
+		double scale;
+	} pgnm[] = {
+		{ "nmea2000_rx_frames_total", "CAN frames received",
+		    &pgn_counters::rx_frames, 1 },
+		{ "nmea2000_rx_bytes_total", "payload bytes received",
+		    &pgn_counters::rx_bytes, 1 },
+		{ "nmea2000_rx_handler_seconds_total",
+		    "time spent handling received frames",
+		    &pgn_counters::rx_ns, 1e-9 },
+		{ "nmea2000_tx_frames_total", "CAN frames sent",
+		    &pgn_counters::tx_frames, 1 },
+		{ "nmea2000_tx_bytes_total", "payload bytes sent",
+		    &pgn_counters::tx_bytes, 1 },
+		{ "nmea2000_tx_errors_total", "CAN frames not sent",
+		    &pgn_counters::tx_errors, 1 },
+	};
+	unsigned long v;
+	int p;
+
+	for (size_t m = 0; m < sizeof(pgnm) / sizeof(pgnm[0]); m++) {
+		metric_head(os, pgnm[m].name, "counter", pgnm[m].help);
+		for (int i = 0; i <= NMEA2000_STATS_PGNS; i++) {
+			const pgn_counters *c =
+			    (i < NMEA2000_STATS_PGNS) ? &pgns[i] : &pgn_other;
+			p = c->pgn.load(std::memory_order_acquire);
+			if (p == -2 || (v = (c->*pgnm[m].c).get()) == 0)
+				continue;
+			os << pgnm[m].name << "{pgn=\"" << p << "\"} ";
+			if (pgnm[m].scale != 1)
+				os << v * pgnm[m].scale << std::endl;
+			else
+				os << v << std::endl;
+		}
+	}
+	metric_head(os, "nmea2000_src_rx_frames_total", "counter",
+	    "CAN frames received by source address");
+	for (int i = 0; i < 256; i++) {
+		if ((v = srcs[i].rx_frames) != 0) {
+			os << "nmea2000_src_rx_frames_total{src=\"" << i
+			    << "\"} " << v << std::endl;
+		}
+	}
+	metric_head(os, "nmea2000_src_rx_bytes_total", "counter",
+	    "payload bytes received by source address");
+	for (int i = 0; i < 256; i++) {
+		if ((v = srcs[i].rx_bytes) != 0) {
+			os << "nmea2000_src_rx_bytes_total{src=\"" << i
+			    << "\"} " << v << std::endl;
+		}
+	}
+	metric_head(os, "nmea2000_tx_errno_total", "counter",
+	    "send errors by errno (0: other)");
+	for (int i = 0; i < NMEA2000_STATS_ERRNO; i++) {
+		if ((v = tx_errno[i]) != 0) {
+			os << "nmea2000_tx_errno_total{errno=\"" << i
+			    << "\"} " << v << std::endl;
+		}
+	}
+	metric_head(os, "nmea2000_rx_dropped_total", "counter",
+	    "frames dropped by the kernel, socket buffer full");
+	os << "nmea2000_rx_dropped_total " << rx_dropped << std::endl;
+	metric_head(os, "nmea2000_claims_sent_total", "counter",
+	    "address claims sent");
+	os << "nmea2000_claims_sent_total " << claims_sent << std::endl;
+	metric_head(os, "nmea2000_claims_lost_total", "counter",
+	    "address conflicts lost, new address picked");
+	os << "nmea2000_claims_lost_total " << claims_lost << std::endl;
+	metric_head(os, "nmea2000_claims_defended_total", "counter",
+	    "address conflicts won, address defended");
+	os << "nmea2000_claims_defended_total " << claims_defended << std::endl;
+}
+
+nmea2000_stats_server::nmea2000_stats_server(nmea2000_metrics_cb c, void *a)
+{
+	cb = c;
+	arg = a;
+	lsock = -1;
+	path = NULL;
+	evloop = NULL;
+	running = false;
+	wakeup[0] = wakeup[1] = -1;
+}
+
+nmea2000_stats_server::~nmea2000_stats_server()
+{
+	char c = 0;
+
+	if (evloop != NULL && lsock >= 0)
+		evloop->del_fd(lsock);
+	while (!clients.empty())
+		ev_close(clients.begin()->first);
+	if (running) {
+		running = false;
+		(void)write(wakeup[1], &c, 1);
+		pthread_join(thread, NULL);
+		close(wakeup[0]);
+		close(wakeup[1]);
+	}
+	if (lsock >= 0)
+		close(lsock);
+	if (path != NULL) {
+		unlink(path);
+		free(path);
+	}
+}
+
+/* spec is a Unix socket path, or a TCP port on the loopback address */
+bool
+nmea2000_stats_server::start(const char *spec, nmea2000_evloop *loop)
+{
+	char *e;
+	long port = strtol(spec, &e, 10);
+
+	if (*e == '\0' && port > 0 && port < 65536) {
+		struct sockaddr_in sin;
+		int on = 1;
+
+		if ((lsock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+			warn("stats socket");
+			return false;
+		}
+		(void)setsockopt(lsock, SOL_SOCKET, SO_REUSEADDR,
+		    &on, sizeof(on));
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		sin.sin_port = htons(port);
+		sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (bind(lsock, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+			warn("bind stats socket to port %ld", port);
+			return false;
+		}
+	} else {
+		struct sockaddr_un sun;
+
+		if (strlen(spec) >= sizeof(sun.sun_path)) {
+			warnx("%s: path too long", spec);
+			return false;
+		}
+		if ((lsock = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+			warn("stats socket");
+			return false;
+		}
+		memset(&sun, 0, sizeof(sun));
+		sun.sun_family = AF_UNIX;
+		strcpy(sun.sun_path, spec);
+		(void)unlink(spec);
+		if (bind(lsock, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+			warn("bind stats socket to %s", spec);
+			return false;
+		}
+		path = strdup(spec);
+	}
+	if (listen(lsock, 8) < 0) {
+		warn("listen stats socket");
+		return false;
+	}
+	fcntl(lsock, F_SETFL, fcntl(lsock, F_GETFL) | O_NONBLOCK);
+	if (loop != NULL) {
+		evloop = loop;
+		evloop->add_fd(lsock, ev_accept, this);
+		return true;
+	}
+	if (pipe(wakeup) < 0) {
+		warn("pipe");
+		return false;
+	}
+	running = true;
+	if (pthread_create(&thread, NULL, server_thread, this)) {
+		warnx("can't create stats thread");
+		running = false;
+		return false;
+	}
+	return true;
+}
+
+/* the HTTP response: the metrics */
+std::string
+nmea2000_stats_server::response()
+{
+	std::ostringstream body, hdr;
+
+	(*cb)(body, arg);
+	hdr << "HTTP/1.0 200 OK\r\n"
+	    << "Content-Type: text/plain; version=0.0.4\r\n"
+	    << "Content-Length: " << body.str().size() << "\r\n"
+	    << "Connection: close\r\n\r\n";
+	return hdr.str() + body.str();
+}
+
+/* answer any request on fd with the metrics, and close it */
+void
+nmea2000_stats_server::serve(int fd)
+{
+	std::string s = response();
+	const char *p;
+	size_t len;
+	ssize_t r;
+
+	for (p = s.data(), len = s.size(); len > 0; p += r, len -= r) {
+		r = write(fd, p, len);
+		if (r < 0 && errno == EINTR) {
+			r = 0;
+			continue;
+		}
+		if (r <= 0)
+			break;
+	}
+	close(fd);
+}
+
+/* read (and ignore) the request, up to the empty line */
+static bool
+read_request(int fd, std::string &req)
+{
+	char buf[512];
+	ssize_t r;
+
+	while ((r = read(fd, buf, sizeof(buf))) > 0) {
+		req.append(buf, r);
+		if (req.find("\r\n\r\n") != std::string::npos ||
+		    req.find("\n\n") != std::string::npos ||
+		    req.size() > 4096)
+			return true;
+	}
+	return (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK));
+}
+
+void
+nmea2000_stats_server::ev_accept(int fd, void *p)
+{
+	nmea2000_stats_server *srv = (nmea2000_stats_server *)p;
+	int c;
+
+	while ((c = accept(fd, NULL, NULL)) >= 0) {
+		fcntl(c, F_SETFL, fcntl(c, F_GETFL) | O_NONBLOCK);
+		if (!srv->evloop->add_fd(c, ev_client, srv)) {
+			close(c);
+			continue;
+		}
+		srv->clients[c].sent = 0;
+	}
+}
+
+void
+nmea2000_stats_server::ev_close(int fd)
+{
+	evloop->del_fd(fd);
+	evloop->del_wfd(fd);
+	clients.erase(fd);
+	close(fd);
+}
+
+/*
+ * one read per wakeup; partial requests are simply answered, there's
+ * nothing in them we care about. The response is then sent as the
+ * socket accepts it, without blocking the loop.
+ */
+void
+nmea2000_stats_server::ev_client(int fd, void *p)
+{
+	nmea2000_stats_server *srv = (nmea2000_stats_server *)p;
+	std::string req;
+
+	(void)read_request(fd, req);
+	srv->evloop->del_fd(fd);
+	srv->clients[fd].out = srv->response();
+	srv->clients[fd].sent = 0;
+	srv->evloop->add_wfd(fd, ev_write, srv);
+}
+
+void
+nmea2000_stats_server::ev_write(int fd, void *p)
+{
+	nmea2000_stats_server *srv = (nmea2000_stats_server *)p;
+	client &c = srv->clients[fd];
+	ssize_t r;
+
+	while (c.sent < c.out.size()) {
+		r = write(fd, c.out.data() + c.sent, c.out.size() - c.sent);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return;
+		if (r <= 0)
+			break;
+		c.sent += r;
+	}
+	srv->ev_close(fd);
+}
+
+void *
+nmea2000_stats_server::server_thread(void *p)
+{
+	nmea2000_stats_server *srv = (nmea2000_stats_server *)p;
+	struct timeval tv;
+	fd_set read_set;
+	int c;
+
+	while (srv->running) {
+		FD_ZERO(&read_set);
+		FD_SET(srv->lsock, &read_set);
+		FD_SET(srv->wakeup[0], &read_set);
+		if (select(std::max(srv->lsock, srv->wakeup[0]) + 1,
+		    &read_set, NULL, NULL, NULL) <= 0)
+			continue;
+		if (!FD_ISSET(srv->lsock, &read_set))
+			continue;
+		while ((c = accept(srv->lsock, NULL, NULL)) >= 0) {
+			std::string req;
+
+			/* don't let a silent client block us forever */
+			tv.tv_sec = 1;
+			tv.tv_usec = 0;
+			fcntl(c, F_SETFL, fcntl(c, F_GETFL) & ~O_NONBLOCK);
+			(void)setsockopt(c, SOL_SOCKET, SO_RCVTIMEO,
+			    &tv, sizeof(tv));
+			(void)setsockopt(c, SOL_SOCKET, SO_SNDTIMEO,
+			    &tv, sizeof(tv));
+			(void)read_request(c, req);
+			srv->serve(c);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_STATS_H_
+#define NMEA2000_STATS_H_
+
+#include <sys/socket.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include <map>
+#include <ostream>
+#include <string>
+
+struct can_frame;
+class nmea2000_evloop;
+
+/*
+ * a counter updated without locks, that can be read at any time from
+ * another thread. Behaves like an unsigned long for the existing users.
+ */
+class nmea2000_counter {
+    public:
+	inline nmea2000_counter() : v(0) {}
+	inline void add(unsigned long n)
+	    { v.fetch_add(n, std::memory_order_relaxed); }
+	inline void set(unsigned long n)
+	    { v.store(n, std::memory_order_relaxed); }
+	inline unsigned long get() const
+	    { return v.load(std::memory_order_relaxed); }
+	inline operator unsigned long() const { return get(); }
+	inline nmea2000_counter &operator=(unsigned long n)
+	    { set(n); return *this; }
+	inline unsigned long operator++(int)
+	    { return v.fetch_add(1, std::memory_order_relaxed); }
+    private:
+	std::atomic<unsigned long> v;
+};
+
+#define NMEA2000_STATS_PGNS	256	/* distinct PGNs tracked, power of 2 */
+#define NMEA2000_STATS_ERRNO	128
+
+/*
+ * bus counters: per PGN, per source address, send errors by errno,
+ * address claim events. PGN slots are allocated on first use with a
+ * compare and swap, so counting never takes a lock; once the table is
+ * full, new PGNs are counted together as pgn -1.
+ */
+class nmea2000_stats {
+    public:
+	nmea2000_stats();
+
+	void rx(const struct can_frame *);
+	void rx_time(int pgn, unsigned long ns);
+	void tx(const struct can_frame *);
+	void tx_error(const struct can_frame *, int err);
+
+	/* cumulated kernel drops, from SO_RXQ_OVFL */
+	nmea2000_counter rx_dropped;
+	nmea2000_counter claims_sent;
+	nmea2000_counter claims_lost;
+	nmea2000_counter claims_defended;
+	volatile bool timing;	/* measure handler time */
+
+	void print(std::ostream &) const;
+
+	static bool rxq_ovfl_enable(int sock);
+	static bool rxq_ovfl_get(struct msghdr *, uint32_t *);
+
+    private:
+	struct pgn_counters {
+		std::atomic<int> pgn;	/* -2: free */
+		nmea2000_counter rx_frames;
+		nmea2000_counter rx_bytes;
+		nmea2000_counter rx_ns;
+		nmea2000_counter tx_frames;
+		nmea2000_counter tx_bytes;
+		nmea2000_counter tx_errors;
+	};
+	struct src_counters {
+		nmea2000_counter rx_frames;
+		nmea2000_counter rx_bytes;
+	};
+	pgn_counters pgns[NMEA2000_STATS_PGNS];
+	pgn_counters pgn_other;
+	src_counters srcs[256];
+	nmea2000_counter tx_errno[NMEA2000_STATS_ERRNO];
+
+	pgn_counters *lookup(int pgn);
+};
+
+/*
+ * serves the output of a print function (Prometheus text format) over
+ * HTTP, on a Unix socket (spec is a path) or on a localhost TCP port.
+ * Runs from the event loop if there's one, from its own thread otherwise.
+ */
+typedef void (*nmea2000_metrics_cb)(std::ostream &, void *);
+
+class nmea2000_stats_server {
+    public:
+	nmea2000_stats_server(nmea2000_metrics_cb, void *);
+	~nmea2000_stats_server();
+
+	bool start(const char *spec, nmea2000_evloop *loop = NULL);
+
+    private:
+	nmea2000_metrics_cb cb;
+	void *arg;
+	int lsock;
+	char *path;
+	nmea2000_evloop *evloop;
+	volatile bool running;
+	pthread_t thread;
+	int wakeup[2];
+	/* event loop clients: the response, and how much was sent */
+	struct client {
+		std::string out;
+		size_t sent;
+	};
+	std::map<int, client> clients;
+
+	std::string response();
+	void serve(int);
+	void ev_close(int);
+	static void ev_accept(int, void *);
+	static void ev_client(int, void *);
+	static void ev_write(int, void *);
+	static void *server_thread(void *);
+};
+
+#endif /* NMEA2000_STATS_H_ */
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <string.h>
+#include <sys/time.h>
+#include <iomanip>
+#include <algorithm>
+#ifndef __NetBSD__
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#endif
+#include "nmea2000_tstamp.h"
+
+#ifdef SO_TIMESTAMPING
+static bool tx_snd_seen;
+#endif
+
+bool
+nmea2000_tstamp_enable(int sock)
+{
+	int on = 1;
+#ifdef SO_TIMESTAMPING
+	/*
+	 * SND stamps are taken by the driver, not all CAN drivers do it;
+	 * SCHED stamps (entering the queue discipline) are always there
+	 * and used until we see a SND one.
+	 */
+	int flags = SOF_TIMESTAMPING_RX_SOFTWARE |
+	    SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_TX_SCHED |
+	    SOF_TIMESTAMPING_SOFTWARE;
+
+	if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPING,
+	    &flags, sizeof(flags)) == 0)
+		return true;
+#endif
+#ifdef SO_TIMESTAMPNS
+	if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0)
+		return false;
+#endif
+	(void)setsockopt(sock, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+	return false;
+}
+
+bool
+nmea2000_tstamp_get(struct msghdr *msg, struct timespec *ts)
+{
+	struct cmsghdr *cm;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+		if (cm->cmsg_level != SOL_SOCKET)
+			continue;
+		switch (cm->cmsg_type) {
+#ifdef SO_TIMESTAMPING
+		case SCM_TIMESTAMPING:
+			/* software, (deprecated), hardware */
+			memcpy(ts, CMSG_DATA(cm), sizeof(*ts));
+			return (ts->tv_sec != 0 || ts->tv_nsec != 0);
+#endif
+#ifdef SO_TIMESTAMPNS
+		case SCM_TIMESTAMPNS:
+			memcpy(ts, CMSG_DATA(cm), sizeof(*ts));
+			return true;
+#endif
+		case SCM_TIMESTAMP:
+		{
+			struct timeval tv;
+			memcpy(&tv, CMSG_DATA(cm), sizeof(tv));
+			TIMEVAL_TO_TIMESPEC(&tv, ts);
+			return true;
+		}
+		}
+	}
+	return false;
+}
+
+bool
+nmea2000_tstamp_gettx(struct msghdr *msg, struct timespec *ts)
+{
+#ifdef SO_TIMESTAMPING
+	struct cmsghdr *cm;
+	struct sock_extended_err ee;
+	bool sched = false;
+
+	for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+		if (cm->cmsg_level == SOL_SOCKET)
+			continue;
+		/* SOL_CAN_RAW/SCM_CAN_RAW_ERRQUEUE, the only other one */
+		memcpy(&ee, CMSG_DATA(cm), sizeof(ee));
+		if (ee.ee_origin != SO_EE_ORIGIN_TIMESTAMPING)
+			return false;
+		if (ee.ee_info == SCM_TSTAMP_SND)
+			tx_snd_seen = true;
+		else if (ee.ee_info == SCM_TSTAMP_SCHED)
+			sched = true;
+		else
+			return false;
+	}
+	if (sched && tx_snd_seen)
+		return false;
+	return nmea2000_tstamp_get(msg, ts);
+#else
+	return false;
+#endif
+}
+
+nmea2000_histogram::nmea2000_histogram()
+{
+	clear();
+}
+
+void
+nmea2000_histogram::clear()
+{
+	for (int i = 0; i < NMEA2000_HIST_SIZE; i++)
+		counts[i].store(0, std::memory_order_relaxed);
+	total.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	min.store(UINT64_MAX, std::memory_order_relaxed);
+	max.store(0, std::memory_order_relaxed);
+}
+
+/*
+ * values below 2 * SUB have their own bucket; above, the bucket is
+ * given by the position of the highest bit and the SUB-1 bits below it.
+ */
+int
+nmea2000_histogram::index(uint64_t v)
+{
+	int e;
+
+	if (v < 2 * NMEA2000_HIST_SUB)
+		return v;
+	e = 63 - __builtin_clzll(v) - __builtin_ctz(NMEA2000_HIST_SUB);
+	if (e > NMEA2000_HIST_EXP)
+		return NMEA2000_HIST_SIZE - 1;
+	return NMEA2000_HIST_SUB * (e + 1) + (v >> e) - NMEA2000_HIST_SUB;
+}
+
+/* highest value falling in bucket i */
+uint64_t
+nmea2000_histogram::upper(int i)
+{
+	int e;
+
+	if (i < 2 * NMEA2000_HIST_SUB)
+		return i;
+	e = i / NMEA2000_HIST_SUB - 1;
+	return (((uint64_t)(i % NMEA2000_HIST_SUB + NMEA2000_HIST_SUB + 1))
+	    << e) - 1;
+}
+
+void
+nmea2000_histogram::record(uint64_t ns)
+{
+	uint64_t m;
+
+	counts[index(ns)].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(ns, std::memory_order_relaxed);
+	m = min.load(std::memory_order_relaxed);
+	while (ns < m &&
+	    !min.compare_exchange_weak(m, ns, std::memory_order_relaxed))
+		;
+	m = max.load(std::memory_order_relaxed);
+	while (ns > m &&
+	    !max.compare_exchange_weak(m, ns, std::memory_order_relaxed))
+		;
+	total.fetch_add(1, std::memory_order_relaxed);
+}
+
+/* highest equivalent value below which p percent of the samples fall */
+uint64_t
+nmea2000_histogram::percentile(double p) const
+{
+	uint64_t n = 0, want, c = count();
+
+	if (c == 0)
+		return 0;
+	want = (uint64_t)(c * p / 100.0 + 0.5);
+	if (want == 0)
+		want = 1;
+	for (int i = 0; i < NMEA2000_HIST_SIZE; i++) {
+		n += counts[i].load(std::memory_order_relaxed);
+		if (n >= want)
+			return std::min(upper(i), max.load(std::memory_order_relaxed));
+	}
+	return max.load(std::memory_order_relaxed);
+}
+
+void
+nmea2000_histogram::print(std::ostream &os, bool buckets) const
+{
+	static const double pcts[] = { 50, 90, 99, 99.9 };
+	static const char *names[] = { "p50", "p90", "p99", "p99.9" };
+	uint64_t c = count();
+	std::ios::fmtflags f = os.flags();
+
+	os << c << " samples";
+	if (c == 0) {
+		os << std::endl;
+		return;
+	}
+	os << std::fixed << std::setprecision(1);
+	os << ", min " << min.load(std::memory_order_relaxed) / 1000.0 << "us";
+	for (size_t i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+		os << " " << names[i] << " " << percentile(pcts[i]) / 1000.0 << "us";
+	os << " max " << max.load(std::memory_order_relaxed) / 1000.0 << "us";
+	os << " avg " << sum.load(std::memory_order_relaxed) / 1000.0 / c << "us";
+	os << std::endl;
+	if (buckets) {
+		for (int i = 0; i < NMEA2000_HIST_SIZE; i++) {
+			uint64_t n = counts[i].load(std::memory_order_relaxed);
+			if (n != 0) {
+				os << "  <=" << upper(i) / 1000.0 << "us: "
+				    << n << std::endl;
+			}
+		}
+	}
+	os.flags(f);
+}
+
+nmea2000_latency::nmea2000_latency() : kernel_tx(false), npairs(0)
+{
+}
+
+/* pairs can be added while the bus runs, but not removed */
+bool
+nmea2000_latency::add(int req_pgn, int resp_pgn)
+{
+	int n = npairs.load(std::memory_order_relaxed);
+
+	if (n >= NMEA2000_LATENCY_PAIRS)
+		return false;
+	pairs[n].req = req_pgn;
+	pairs[n].resp = resp_pgn;
+	pairs[n].pending.store(0, std::memory_order_relaxed);
+	npairs.store(n + 1, std::memory_order_release);
+	return true;
+}
+
+bool
+nmea2000_latency::isrequest(int pgn) const
+{
+	int n = npairs.load(std::memory_order_acquire);
+
+	for (int i = 0; i < n; i++) {
+		if (pairs[i].req == pgn)
+			return true;
+	}
+	return false;
+}
+
+static inline uint64_t
+ts2ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+void
+nmea2000_latency::request(int pgn, const struct timespec *ts)
+{
+	int n = npairs.load(std::memory_order_acquire);
+	uint64_t zero;
+
+	for (int i = 0; i < n; i++) {
+		if (pairs[i].req != pgn)
+			continue;
+		zero = 0;
+		pairs[i].pending.compare_exchange_strong(zero, ts2ns(ts),
+		    std::memory_order_relaxed);
+	}
+}
+
+void
+nmea2000_latency::response(int pgn, const struct timespec *ts)
+{
+	int n = npairs.load(std::memory_order_acquire);
+	uint64_t t = ts2ns(ts), req;
+
+	for (int i = 0; i < n; i++) {
+		if (pairs[i].resp != pgn)
+			continue;
+		req = pairs[i].pending.exchange(0, std::memory_order_relaxed);
+		if (req != 0 && t >= req)
+			pairs[i].hist.record(t - req);
+	}
+}
+
+void
+nmea2000_latency::print(std::ostream &os, bool buckets) const
+{
+	int n = npairs.load(std::memory_order_acquire);
+
+	for (int i = 0; i < n; i++) {
+		os << "latency " << pairs[i].req << " -> " << pairs[i].resp
+		    << (kernel_tx ? "" : " (userland tx)") << ": ";
+		pairs[i].hist.print(os, buckets);
+	}
+}
+
+/* as a Prometheus summary */
+void
+nmea2000_latency::print_metrics(std::ostream &os) const
+{
+	static const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+	int n = npairs.load(std::memory_order_acquire);
+
+	if (n == 0)
+		return;
+	os << "# HELP nmea2000_latency_seconds request to response latency"
+	    << std::endl;
+	os << "# TYPE nmea2000_latency_seconds summary" << std::endl;
+	for (int i = 0; i < n; i++) {
+		const nmea2000_histogram &h = pairs[i].hist;
+		for (size_t j = 0; j < sizeof(q) / sizeof(q[0]); j++) {
+			os << "nmea2000_latency_seconds{req=\"" << pairs[i].req
+			    << "\",resp=\"" << pairs[i].resp << "\",quantile=\""
+			    << q[j] << "\"} " << h.percentile(q[j] * 100) / 1e9
+			    << std::endl;
+		}
+		os << "nmea2000_latency_seconds_sum{req=\"" << pairs[i].req
+		    << "\",resp=\"" << pairs[i].resp << "\"} "
+		    << h.sumns() / 1e9 << std::endl;
+		os << "nmea2000_latency_seconds_count{req=\"" << pairs[i].req
+		    << "\",resp=\"" << pairs[i].resp << "\"} "
+		    << h.count() << std::endl;
+	}
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_TSTAMP_H_
+#define NMEA2000_TSTAMP_H_
+
+#include <sys/socket.h>
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <ostream>
+
+/*
+ * socket timestamps. On Linux, SO_TIMESTAMPING gives the kernel receive
+ * time of each frame and, through the error queue, the time each of our
+ * frames was handed to the driver. Elsewhere SO_TIMESTAMP gives the
+ * receive time only, and transmit times are taken in userland right
+ * after the send. All timestamps are CLOCK_REALTIME.
+ */
+#define NMEA2000_CMSG_SIZE	128	/* room for the timestamp cmsgs */
+
+/* enable timestamps on sock; true if tx timestamps were requested too */
+bool nmea2000_tstamp_enable(int sock);
+/* extract the timestamp from a received message, false if none */
+bool nmea2000_tstamp_get(struct msghdr *, struct timespec *);
+/*
+ * extract the timestamp from an error queue message. Returns false if
+ * none, or if it's a queueing (not transmit) stamp and we already got
+ * transmit stamps from this driver.
+ */
+bool nmea2000_tstamp_gettx(struct msghdr *, struct timespec *);
+
+/*
+ * HDR-style latency histogram: values are in ns, each power of two is
+ * split in NMEA2000_HIST_SUB linear buckets, so the precision is about
+ * 1/NMEA2000_HIST_SUB whatever the magnitude (up to about 36 minutes).
+ * record() only does relaxed atomic increments, it may be called from
+ * any thread while another one prints the histogram.
+ */
+#define NMEA2000_HIST_SUB	16
+#define NMEA2000_HIST_EXP	36
+#define NMEA2000_HIST_SIZE	(2 * NMEA2000_HIST_SUB + NMEA2000_HIST_EXP * NMEA2000_HIST_SUB)
+
+class nmea2000_histogram {
+    public:
+	nmea2000_histogram();
+
+	void record(uint64_t ns);
+	void clear();
+	uint64_t count() const { return total.load(std::memory_order_relaxed); }
+	uint64_t sumns() const { return sum.load(std::memory_order_relaxed); }
+	uint64_t percentile(double) const;
+	void print(std::ostream &, bool buckets) const;
+
+	static int index(uint64_t);
+	static uint64_t upper(int);
+    private:
+	std::atomic<uint64_t> counts[NMEA2000_HIST_SIZE];
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> min;
+	std::atomic<uint64_t> max;
+};
+
+#define NMEA2000_LATENCY_PAIRS 8
+
+/*
+ * request -> response latency, for pairs of PGNs: the time from the
+ * reception of a request PGN to the transmission of the first frame of
+ * the response PGN that follows it. A request arriving while a previous
+ * one is still unanswered doesn't restart the measure: we record the
+ * worst case, the time the oldest pending request waited.
+ */
+class nmea2000_latency {
+    public:
+	nmea2000_latency();
+
+	bool add(int req_pgn, int resp_pgn);
+	inline int size() const { return npairs; }
+	bool isrequest(int pgn) const;
+	inline int getrequest(int i) const { return pairs[i].req; }
+	void request(int pgn, const struct timespec *);
+	void response(int pgn, const struct timespec *);
+	void print(std::ostream &, bool buckets) const;
+	void print_metrics(std::ostream &) const;
+
+	volatile bool kernel_tx;	/* tx stamps come from the kernel */
+    private:
+	struct pair {
+		int req;
+		int resp;
+		std::atomic<uint64_t> pending;	/* ns, 0 if none */
+		nmea2000_histogram hist;
+	};
+	pair pairs[NMEA2000_LATENCY_PAIRS];
+	std::atomic<int> npairs;
+};
+
+#endif /* NMEA2000_TSTAMP_H_ */
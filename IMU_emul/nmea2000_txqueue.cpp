@@ -0,0 +1,360 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <assert.h>
+#include <algorithm>
+#include "nmea2000_defs_tx.h"
+#include "nmea2000_evloop.h"
+#include "nmea2000_txqueue.h"
+
+nmea2000_txqueue::nmea2000_txqueue()
+{
+	for (int i = 0; i < NMEA2000_TXQ_UNITS; i++)
+		units[i].next = (i + 1 < NMEA2000_TXQ_UNITS) ? i + 1 : -1;
+	freelist = 0;
+	for (int p = 0; p < NMEA2000_TXQ_PRIOS; p++)
+		head[p] = tail[p] = -1;
+	cur = -1;
+	nframes = 0;
+	retry_ms = NMEA2000_TXQ_RETRY_MIN;
+	sock = -1;
+	sentcb = NULL;
+	blockcb = NULL;
+	cbarg = NULL;
+	stats = NULL;
+	pthread_mutex_init(&mtx, NULL);
+}
+
+nmea2000_txqueue::~nmea2000_txqueue()
+{
+	pthread_mutex_destroy(&mtx);
+}
+
+void
+nmea2000_txqueue::setcb(nmea2000_txq_sentcb s, nmea2000_txq_blockcb b, void *a)
+{
+	sentcb = s;
+	blockcb = b;
+	cbarg = a;
+}
+
+void
+nmea2000_txqueue::unlink(int p, int u, int prev)
+{
+	if (prev < 0)
+		head[p] = units[u].next;
+	else
+		units[prev].next = units[u].next;
+	if (tail[p] == u)
+		tail[p] = prev;
+}
+
+void
+nmea2000_txqueue::release(int u)
+{
+	nframes -= units[u].nframes - units[u].done;
+	units[u].next = freelist;
+	freelist = u;
+}
+
+/* the unsent frames of u are lost */
+void
+nmea2000_txqueue::drop_unit(int u, int err)
+{
+	if (stats != NULL) {
+		for (int i = units[u].done; i < units[u].nframes; i++)
+			stats->tx_error(&units[u].frames[i], err);
+	}
+	release(u);
+}
+
+/*
+ * make room for need frames and a unit, evicting the newest units of
+ * priorities lower than p. Nothing is evicted if that's not enough.
+ */
+bool
+nmea2000_txqueue::evict(int p, int need)
+{
+	int room = NMEA2000_TXQ_FRAMES - nframes;
+	bool haveunit = (freelist >= 0);
+	int q, u;
+
+	for (q = NMEA2000_TXQ_PRIOS - 1; q > p; q--) {
+		for (u = head[q]; u >= 0; u = units[u].next) {
+			room += units[u].nframes;
+			haveunit = true;
+		}
+		if (room >= need && haveunit)
+			break;
+	}
+	if (room < need || !haveunit)
+		return false;
+	while (NMEA2000_TXQ_FRAMES - nframes < need || freelist < 0) {
+		int prev = -1;
+
+		for (q = NMEA2000_TXQ_PRIOS - 1; head[q] < 0; q--)
+			;
+		assert(q > p);
+		for (u = head[q]; units[u].next >= 0; u = units[u].next)
+			prev = u;
+		unlink(q, u, prev);
+		evicted++;
+		drop_unit(u, ENOBUFS);
+	}
+	return true;
+}
+
+/* queue frames [from, to) of batch as a unit */
+bool
+nmea2000_txqueue::enqueue(const nmea2000_txbatch &batch, int from, int to,
+    bool periodic)
+{
+	int n = to - from;
+	int p, u, prev;
+
+	if (n <= 0)
+		return false;
+	if (n > NMEA2000_TXQ_UNITLEN) {
+		dropped_full++;
+		return false;
+	}
+	p = prio(batch.get(from));
+	pthread_mutex_lock(&mtx);
+	if (periodic) {
+		for (u = head[p]; u >= 0; u = units[u].next) {
+			if (!units[u].periodic || units[u].nframes != n ||
+			    units[u].frames[0].can_id != batch.get(from)->can_id)
+				continue;
+			/* same place in the queue, newest content */
+			for (int i = 0; i < n; i++)
+				units[u].frames[i] = *batch.get(from + i);
+			superseded++;
+			pthread_mutex_unlock(&mtx);
+			return true;
+		}
+	}
+	if ((freelist < 0 || nframes + n > NMEA2000_TXQ_FRAMES) &&
+	    !evict(p, n)) {
+		dropped_full++;
+		if (stats != NULL) {
+			for (int i = from; i < to; i++)
+				stats->tx_error(batch.get(i), ENOBUFS);
+		}
+		pthread_mutex_unlock(&mtx);
+		return false;
+	}
+	u = freelist;
+	freelist = units[u].next;
+	units[u].next = -1;
+	units[u].periodic = periodic;
+	units[u].nframes = n;
+	units[u].done = 0;
+	for (int i = 0; i < n; i++)
+		units[u].frames[i] = *batch.get(from + i);
+	prev = tail[p];
+	if (prev < 0)
+		head[p] = u;
+	else
+		units[prev].next = u;
+	tail[p] = u;
+	nframes += n;
+	queued++;
+	if ((unsigned long)nframes > highwater)
+		highwater = nframes;
+	pthread_mutex_unlock(&mtx);
+	return true;
+}
+
+/*
+ * send as much as the socket takes, without blocking. Returns true if
+ * the queue is empty; otherwise the block callback was told what to
+ * wait for.
+ */
+bool
+nmea2000_txqueue::flush(void)
+{
+	struct mmsghdr msgs[NMEA2000_TXBATCH_MAX];
+	struct iovec iov[NMEA2000_TXBATCH_MAX];
+	struct timespec retry;
+	int n, r, p, u, e = 0;
+	bool empty;
+
+	pthread_mutex_lock(&mtx);
+	for (;;) {
+		/* cur first, then by priority */
+		if (cur < 0) {
+			for (p = 0; p < NMEA2000_TXQ_PRIOS && head[p] < 0; p++)
+				;
+			if (p == NMEA2000_TXQ_PRIOS)
+				break;
+			cur = head[p];
+			unlink(p, cur, -1);
+		}
+		n = 0;
+		u = cur;
+		p = 0;
+		while (n < NMEA2000_TXBATCH_MAX) {
+			for (int i = units[u].done; i < units[u].nframes &&
+			    n < NMEA2000_TXBATCH_MAX; i++, n++) {
+				memset(&msgs[n], 0, sizeof(msgs[n]));
+				iov[n].iov_base = &units[u].frames[i];
+				iov[n].iov_len = sizeof(struct can_frame);
+				msgs[n].msg_hdr.msg_iov = &iov[n];
+				msgs[n].msg_hdr.msg_iovlen = 1;
+			}
+			/* next unit in send order */
+			if (u == cur) {
+				for (p = 0; p < NMEA2000_TXQ_PRIOS && head[p] < 0; p++)
+					;
+				u = (p < NMEA2000_TXQ_PRIOS) ? head[p] : -1;
+			} else if ((u = units[u].next) < 0) {
+				for (p++; p < NMEA2000_TXQ_PRIOS && head[p] < 0; p++)
+					;
+				u = (p < NMEA2000_TXQ_PRIOS) ? head[p] : -1;
+			}
+			if (u < 0)
+				break;
+		}
+		r = sendmmsg(sock, msgs, n, MSG_DONTWAIT);
+		e = errno;
+		if (r < 0 && e == EINTR)
+			continue;
+		if (r <= 0) {
+			if (e == EAGAIN || e == EWOULDBLOCK || e == ENOBUFS)
+				break;
+			/* hard error: give up this unit, try the next */
+			dropped_error++;
+			drop_unit(cur, e);
+			cur = -1;
+			continue;
+		}
+		retry_ms = NMEA2000_TXQ_RETRY_MIN;
+		sent.add(r);
+		/* account for the r frames, unit by unit in the same order */
+		while (r > 0) {
+			int left = units[cur].nframes - units[cur].done;
+			int k = (r < left) ? r : left;
+
+			for (int i = 0; i < k; i++) {
+				if (sentcb != NULL)
+					(*sentcb)(&units[cur].frames[
+					    units[cur].done + i], cbarg);
+			}
+			units[cur].done += k;
+			nframes -= k;
+			r -= k;
+			if (units[cur].done < units[cur].nframes)
+				break;
+			units[cur].next = freelist;
+			freelist = cur;
+			cur = -1;
+			if (r == 0)
+				break;
+			for (p = 0; p < NMEA2000_TXQ_PRIOS && head[p] < 0; p++)
+				;
+			assert(p < NMEA2000_TXQ_PRIOS);
+			cur = head[p];
+			unlink(p, cur, -1);
+		}
+	}
+	empty = (cur < 0 && nframes == 0);
+	if (!empty) {
+		blocked++;
+		if (e == ENOBUFS) {
+			/* device queue full; writability tells nothing */
+			nmea2000_evloop::now(&retry);
+			nmea2000_evloop::addms(&retry, retry_ms);
+			retry_ms = std::min(retry_ms * 2, NMEA2000_TXQ_RETRY_MAX);
+			if (blockcb != NULL)
+				(*blockcb)(false, &retry, cbarg);
+		} else if (blockcb != NULL) {
+			(*blockcb)(true, NULL, cbarg);
+		}
+	}
+	pthread_mutex_unlock(&mtx);
+	return empty;
+}
+
+bool
+nmea2000_txqueue::empty(void)
+{
+	bool e;
+
+	pthread_mutex_lock(&mtx);
+	e = (cur < 0 && nframes == 0);
+	pthread_mutex_unlock(&mtx);
+	return e;
+}
+
+void
+nmea2000_txqueue::print_stats(std::ostream &os)
+{
+	os << "tx queue: " << queued << " queued, " << sent << " frames sent, "
+	    << superseded << " superseded, " << evicted << " evicted, "
+	    << dropped_full << " dropped (full), " << dropped_error
+	    << " dropped (error), " << blocked << " blocked, highwater "
+	    << highwater << std::endl;
+}
+
+void
+nmea2000_txqueue::print_metrics(std::ostream &os)
+{
+	static const struct {
+		const char *name;
+		const char *help;
+		nmea2000_counter nmea2000_txqueue::*c;
+	} m[] = {
+		{ "nmea2000_txq_queued_total", "PGNs queued",
+		    &nmea2000_txqueue::queued },
+		{ "nmea2000_txq_sent_total", "frames sent from the queue",
+		    &nmea2000_txqueue::sent },
+		{ "nmea2000_txq_superseded_total",
+		    "stale periodic PGNs replaced", &nmea2000_txqueue::superseded },
+		{ "nmea2000_txq_evicted_total",
+		    "PGNs dropped for a higher priority one",
+		    &nmea2000_txqueue::evicted },
+		{ "nmea2000_txq_dropped_full_total", "PGNs dropped, queue full",
+		    &nmea2000_txqueue::dropped_full },
+		{ "nmea2000_txq_dropped_error_total",
+		    "PGNs dropped on a send error",
+		    &nmea2000_txqueue::dropped_error },
+		{ "nmea2000_txq_blocked_total", "socket or device queue full",
+		    &nmea2000_txqueue::blocked },
+	};
+
+	for (size_t i = 0; i < sizeof(m) / sizeof(m[0]); i++) {
+		os << "# HELP " << m[i].name << " " << m[i].help << std::endl;
+		os << "# TYPE " << m[i].name << " counter" << std::endl;
+		os << m[i].name << " " << (this->*m[i].c).get() << std::endl;
+	}
+	os << "# HELP nmea2000_txq_highwater_frames max frames queued" << std::endl;
+	os << "# TYPE nmea2000_txq_highwater_frames gauge" << std::endl;
+	os << "nmea2000_txq_highwater_frames " << highwater << std::endl;
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef NMEA2000_TXQUEUE_H_
+#define NMEA2000_TXQUEUE_H_
+
+#include <sys/socket.h>
+#include <pthread.h>
+#include <time.h>
+#include <ostream>
+#include "nmea2000_frame.h"
+#include "nmea2000_stats.h"
+
+class nmea2000_txbatch;
+
+#define NMEA2000_TXQ_FRAMES	256	/* max frames queued */
+#define NMEA2000_TXQ_UNITS	128	/* max PGNs queued */
+#define NMEA2000_TXQ_UNITLEN	32	/* max frames per PGN (fast packet) */
+#define NMEA2000_TXQ_PRIOS	8
+#define NMEA2000_TXQ_RETRY_MIN	1	/* ms, after ENOBUFS */
+#define NMEA2000_TXQ_RETRY_MAX	32
+
+/* frames of a unit actually went out */
+typedef void (*nmea2000_txq_sentcb)(const struct can_frame *, void *);
+/*
+ * the queue can't make progress: wait for the socket to be writable
+ * (pollout) or until retry, then call flush() again.
+ */
+typedef void (*nmea2000_txq_blockcb)(bool pollout,
+    const struct timespec *retry, void *);
+
+/*
+ * software transmit queue in front of a CAN socket.
+ * A unit is all the frames of one PGN transmission (one frame, or the
+ * segments of a fast packet). Units are sent by CAN priority, in order
+ * within a priority, and once started a unit is completed before any
+ * other one goes out, so fast packets are never cut or interleaved.
+ * The queue is bounded: when full, a new unit evicts the newest queued
+ * unit of a lower priority, or is dropped. A periodic unit replaces an
+ * unsent one with the same CAN id, the receiver only wants the newest
+ * value. Everything dropped is counted.
+ */
+class nmea2000_txqueue {
+    public:
+	nmea2000_txqueue();
+	~nmea2000_txqueue();
+
+	inline void setsock(int s) { sock = s; }
+	void setcb(nmea2000_txq_sentcb, nmea2000_txq_blockcb, void *);
+
+	bool enqueue(const nmea2000_txbatch &, int from, int to,
+	    bool periodic);
+	bool flush(void);
+	bool empty(void);
+	void print_stats(std::ostream &);
+	void print_metrics(std::ostream &);
+
+	nmea2000_counter queued;
+	nmea2000_counter sent;		/* frames */
+	nmea2000_counter superseded;	/* stale periodic units replaced */
+	nmea2000_counter evicted;	/* dropped for a higher priority one */
+	nmea2000_counter dropped_full;	/* dropped, queue full */
+	nmea2000_counter dropped_error;	/* dropped on a send error */
+	nmea2000_counter blocked;	/* EAGAIN or ENOBUFS */
+	nmea2000_counter highwater;	/* max frames queued */
+	nmea2000_stats *stats;		/* per-PGN errors, if not NULL */
+
+    private:
+	struct unit {
+		int next;
+		bool periodic;
+		int nframes;
+		int done;	/* frames already sent */
+		struct can_frame frames[NMEA2000_TXQ_UNITLEN];
+	};
+	unit units[NMEA2000_TXQ_UNITS];
+	int freelist;
+	int head[NMEA2000_TXQ_PRIOS];
+	int tail[NMEA2000_TXQ_PRIOS];
+	int cur;	/* unit being sent, not in the lists */
+	int nframes;	/* frames queued, cur included */
+	int retry_ms;
+	int sock;
+	pthread_mutex_t mtx;
+	nmea2000_txq_sentcb sentcb;
+	nmea2000_txq_blockcb blockcb;
+	void *cbarg;
+
+	static inline int prio(const struct can_frame *f)
+	    { return (f->can_id >> 26) & 0x7; }
+	bool evict(int prio, int need);
+	void unlink(int prio, int u, int prev);
+	void release(int u);
+	void drop_unit(int u, int err);
+};
+
+#endif /* NMEA2000_TXQUEUE_H_ */
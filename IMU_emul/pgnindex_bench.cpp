@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * microbenchmark of nmea2000_pgn_index: the cost of a PGN lookup with 3
+ * to 200 registered PGNs, against the linear scan of the descriptors it
+ * replaced. The lookups are 90% hits and 10% misses, as a busy bus
+ * carries PGNs nobody registered. Both lookups are also checked to
+ * agree; exits with status 1 if they don't.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <time.h>
+
+#include <array>
+#include <vector>
+
+#include "nmea2000_defs.h"
+
+#define NLOOKUPS 4096
+
+static int nfail;
+/* so that the lookups are not optimised away */
+static volatile int sink;
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a PGN, PDU1 (destination in the low byte, 0) or PDU2 */
+static int
+random_pgn(void)
+{
+	if (random() & 1)
+		return (random() % 0xf0) << 8;
+	return 0x1f000 + random() % 0x1000;
+}
+
+template <size_t N> static int
+linear_lookup(const std::array<nmea2000_desc *, N> &descs, int pgn)
+{
+	for (size_t i = 0; i < N; i++) {
+		if (descs[i]->pgn == pgn)
+			return i;
+	}
+	return -1;
+}
+
+template <size_t N> static void
+bench(void)
+{
+	std::array<nmea2000_desc *, N> descs;
+	nmea2000_pgn_index<N> index;
+	std::vector<int> pgns(NLOOKUPS);
+	double start, t_hash, t_linear;
+	long n, i;
+	int sum = 0;
+
+	srandom(N);
+	for (size_t d = 0; d < N; d++) {
+		int pgn;
+	again:
+		pgn = random_pgn();
+		for (size_t j = 0; j < d; j++) {
+			if (descs[j]->pgn == pgn)
+				goto again;
+		}
+		descs[d] = new nmea2000_desc("bench", false, pgn);
+	}
+	index.build(descs);
+
+	for (i = 0; i < NLOOKUPS; i++) {
+		if (random() % 10 != 0) {
+			pgns[i] = descs[random() % N]->pgn;
+			continue;
+		}
+		do {
+			pgns[i] = random_pgn();
+		} while (linear_lookup(descs, pgns[i]) >= 0);
+	}
+	for (i = 0; i < NLOOKUPS; i++) {
+		if (index.lookup(pgns[i]) != linear_lookup(descs, pgns[i])) {
+			warnx("%zu PGNs: PGN %d: index %d, linear %d", N,
+			    pgns[i], index.lookup(pgns[i]),
+			    linear_lookup(descs, pgns[i]));
+			nfail++;
+		}
+	}
+
+	/* about 0.2s each */
+	n = 0;
+	start = now();
+	do {
+		for (i = 0; i < NLOOKUPS; i++)
+			sum += index.lookup(pgns[i]);
+		n += NLOOKUPS;
+	} while ((t_hash = now() - start) < 0.2);
+	t_hash /= n;
+	n = 0;
+	start = now();
+	do {
+		for (i = 0; i < NLOOKUPS; i++)
+			sum += linear_lookup(descs, pgns[i]);
+		n += NLOOKUPS;
+	} while ((t_linear = now() - start) < 0.2);
+	t_linear /= n;
+
+	sink = sum;
+	printf("%4zu PGNs: index %6.2fns linear %7.2fns\n", N,
+	    t_hash * 1e9, t_linear * 1e9);
+	for (size_t d = 0; d < N; d++)
+		delete descs[d];
+}
+
+int
+main(void)
+{
+	bench<3>();
+	bench<8>();
+	bench<16>();
+	bench<32>();
+	bench<64>();
+	bench<128>();
+	bench<200>();
+	if (nfail != 0)
+		errx(1, "%d lookups differ", nfail);
+	exit(0);
+}
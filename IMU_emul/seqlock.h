@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SEQLOCK_H_
+#define SEQLOCK_H_
+
+#include <atomic>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * sequence lock around a small, trivially copyable record.
+ * Writers publish a whole record; readers get a consistent copy without
+ * locking, retrying if a write happened while they were copying.
+ * Several writers are serialised on the sequence counter itself.
+ * The record is stored as relaxed atomic words, so a reader racing with
+ * a writer is well defined (and then discarded).
+ */
+template <class T> class seqlock {
+    public:
+	inline seqlock() : seq(0)
+	    {
+		T v;
+		memset(&v, 0, sizeof(v));
+		store(v);
+	    }
+
+	void write(const T &v)
+	    {
+		unsigned s = seq.load(std::memory_order_relaxed);
+		for (;;) {
+			if ((s & 1) == 0 &&
+			    seq.compare_exchange_weak(s, s + 1,
+			    std::memory_order_acquire))
+				break;
+			s = seq.load(std::memory_order_relaxed);
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		store(v);
+		seq.store(s + 2, std::memory_order_release);
+	    }
+
+	T read(void) const
+	    {
+		T v;
+		unsigned s1, s2;
+		do {
+			while ((s1 = seq.load(std::memory_order_acquire)) & 1)
+				;
+			load(v);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			s2 = seq.load(std::memory_order_relaxed);
+		} while (s1 != s2);
+		return v;
+	    }
+
+    private:
+	static const size_t nwords = (sizeof(T) + 7) / 8;
+	std::atomic<unsigned> seq;
+	std::atomic<uint64_t> words[nwords];
+
+	inline void store(const T &v)
+	    {
+		uint64_t w[nwords];
+		w[nwords - 1] = 0;
+		memcpy(w, &v, sizeof(T));
+		for (size_t i = 0; i < nwords; i++)
+			words[i].store(w[i], std::memory_order_relaxed);
+	    }
+	inline void load(T &v) const
+	    {
+		uint64_t w[nwords];
+		for (size_t i = 0; i < nwords; i++)
+			w[i] = words[i].load(std::memory_order_relaxed);
+		memcpy(&v, w, sizeof(T));
+	    }
+};
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * stress test for seqlock.h: several writers and readers hammer the same
+ * seqlock for a few seconds. Every field of a record derives from one
+ * counter, so a reader can tell if it got a torn record; it also checks
+ * that it never sees a writer going back in time.
+ * Exits with status 1 if anything is wrong.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "seqlock.h"
+
+#define MAXWRITERS 64
+
+/* same layout as IMU_emul's vessel_state */
+struct vessel_state {
+	double rot;
+	double pitch;
+	double roll;
+};
+
+/* a larger one, more likely to be torn */
+struct big_state {
+	double v[16];
+};
+
+/* counter: writer number in the high bits, a sequence in the low ones */
+static inline uint64_t
+mkcount(int w, uint64_t n)
+{
+	return ((uint64_t)w << 40) | n;
+}
+
+static inline void
+encode(vessel_state *s, uint64_t c)
+{
+	s->rot = c;
+	s->pitch = c + 0.5;
+	s->roll = -(double)c;
+}
+
+static inline bool
+decode(const vessel_state *s, uint64_t *c)
+{
+	*c = s->rot;
+	return s->pitch == *c + 0.5 && s->roll == -(double)*c;
+}
+
+static inline void
+encode(big_state *s, uint64_t c)
+{
+	for (int i = 0; i < 16; i++)
+		s->v[i] = c + i;
+}
+
+static inline bool
+decode(const big_state *s, uint64_t *c)
+{
+	*c = s->v[0];
+	for (int i = 1; i < 16; i++) {
+		if (s->v[i] != *c + i)
+			return false;
+	}
+	return true;
+}
+
+static std::atomic<bool> stop;
+static std::atomic<uint64_t> nfail;
+
+template <class T> static void
+writer(seqlock<T> *sl, int w, uint64_t *nwrites)
+{
+	uint64_t n;
+	T v;
+
+	for (n = 1; !stop.load(std::memory_order_relaxed); n++) {
+		encode(&v, mkcount(w, n));
+		sl->write(v);
+	}
+	*nwrites = n - 1;
+}
+
+template <class T> static void
+reader(seqlock<T> *sl, uint64_t *nreads)
+{
+	uint64_t last[MAXWRITERS] = { 0 };
+	uint64_t n, c;
+	int w;
+	T v;
+
+	for (n = 0; !stop.load(std::memory_order_relaxed); n++) {
+		v = sl->read();
+		if (!decode(&v, &c)) {
+			if (nfail++ < 10)
+				warnx("torn record at read %ju", (uintmax_t)n);
+			continue;
+		}
+		w = c >> 40;
+		c &= ((uint64_t)1 << 40) - 1;
+		if (c == 0)	/* initial record */
+			continue;
+		if (w >= MAXWRITERS || c < last[w]) {
+			if (nfail++ < 10)
+				warnx("writer %d went back from %ju to %ju",
+				    w, (uintmax_t)last[w], (uintmax_t)c);
+			continue;
+		}
+		last[w] = c;
+	}
+	*nreads = n;
+}
+
+template <class T> static void
+run(const char *name, int nw, int nr, int secs)
+{
+	seqlock<T> sl;
+	std::vector<std::thread> threads;
+	std::vector<uint64_t> counts(nw + nr);
+	uint64_t nwrites = 0, nreads = 0;
+
+	stop = false;
+	for (int i = 0; i < nw; i++)
+		threads.push_back(std::thread(writer<T>, &sl, i, &counts[i]));
+	for (int i = 0; i < nr; i++) {
+		threads.push_back(std::thread(reader<T>, &sl,
+		    &counts[nw + i]));
+	}
+	sleep(secs);
+	stop = true;
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	for (int i = 0; i < nw; i++)
+		nwrites += counts[i];
+	for (int i = 0; i < nr; i++)
+		nreads += counts[nw + i];
+	printf("%s: %d writers %ju writes, %d readers %ju reads\n",
+	    name, nw, (uintmax_t)nwrites, nr, (uintmax_t)nreads);
+}
+
+static void
+usage(void)
+{
+	fprintf(stderr, "usage: %s [-w writers] [-r readers] [-t seconds]\n",
+	    getprogname());
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	int nw = 4, nr = 4, secs = 2;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "r:t:w:")) != -1) {
+		switch (ch) {
+		case 'r':
+			nr = atoi(optarg);
+			break;
+		case 't':
+			secs = atoi(optarg);
+			break;
+		case 'w':
+			nw = atoi(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (nw < 1 || nw > MAXWRITERS || nr < 1 || secs < 1)
+		usage();
+
+	run<vessel_state>("vessel_state", nw, nr, secs);
+	run<big_state>("big_state", nw, nr, secs);
+	if (nfail != 0)
+		errx(1, "%ju errors", (uintmax_t)nfail.load());
+	exit(0);
+}
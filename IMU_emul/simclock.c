@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include "simclock.h"
+
+static enum simclock_mode mode = SIMCLOCK_REAL;
+static double factor = 1;
+static int64_t real0;	/* real time at init, ns */
+static int64_t fast_now; /* current simulated time in fast mode, ns */
+
+static int64_t
+ts2ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000LL + ts->tv_nsec;
+}
+
+static void
+ns2ts(int64_t ns, struct timespec *ts)
+{
+	ts->tv_sec = ns / 1000000000LL;
+	ts->tv_nsec = ns % 1000000000LL;
+}
+
+static int64_t
+real_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts2ns(&ts);
+}
+
+/* "real", "fast" or a speed factor; NULL means the environment, or real */
+int
+simclock_init(const char *spec)
+{
+	char *e;
+	double f;
+
+	if (spec == NULL)
+		spec = getenv(SIMCLOCK_ENV);
+	if (spec == NULL || *spec == '\0')
+		spec = "real";
+	if (strcmp(spec, "real") == 0) {
+		mode = SIMCLOCK_REAL;
+		factor = 1;
+	} else if (strcmp(spec, "fast") == 0) {
+		mode = SIMCLOCK_FAST;
+		factor = 0;
+	} else {
+		f = strtod(spec, &e);
+		if (e == spec || *e != '\0' || !(f > 0)) {
+			errno = EINVAL;
+			return -1;
+		}
+		mode = (f == 1) ? SIMCLOCK_REAL : SIMCLOCK_SCALED;
+		factor = f;
+	}
+	real0 = fast_now = real_ns();
+	return 0;
+}
+
+enum simclock_mode
+simclock_mode(void)
+{
+	return mode;
+}
+
+/* simulated seconds per real second, 0 in fast mode */
+double
+simclock_factor(void)
+{
+	return factor;
+}
+
+void
+simclock_now(struct timespec *ts)
+{
+	switch(mode) {
+	case SIMCLOCK_REAL:
+		clock_gettime(CLOCK_MONOTONIC, ts);
+		break;
+	case SIMCLOCK_SCALED:
+		ns2ts(real0 + (int64_t)((real_ns() - real0) * factor), ts);
+		break;
+	case SIMCLOCK_FAST:
+		ns2ts(fast_now, ts);
+		break;
+	}
+}
+
+/* real time left until a simulated deadline; zero if it's already past */
+void
+simclock_timeout(const struct timespec *deadline, struct timespec *ts)
+{
+	struct timespec now;
+	int64_t left;
+
+	simclock_now(&now);
+	left = ts2ns(deadline) - ts2ns(&now);
+	if (left <= 0 || mode == SIMCLOCK_FAST)
+		left = 0;
+	else if (mode == SIMCLOCK_SCALED)
+		left = (int64_t)(left / factor) + 1;
+	ns2ts(left, ts);
+}
+
+/* CLOCK_MONOTONIC deadline matching a simulated one, for timed waits */
+void
+simclock_realtime(const struct timespec *deadline, struct timespec *ts)
+{
+	struct timespec left;
+
+	if (mode == SIMCLOCK_REAL) {
+		*ts = *deadline;
+		return;
+	}
+	simclock_timeout(deadline, &left);
+	ns2ts(real_ns() + ts2ns(&left), ts);
+}
+
+/*
+ * select() until the descriptors are ready or the simulated deadline
+ * (NULL: none) is reached. In fast mode, this only polls the
+ * descriptors, and if none is ready the clock jumps to the deadline.
+ */
+int
+simclock_select(int nfds, fd_set *r, fd_set *w, fd_set *x,
+    const struct timespec *deadline)
+{
+	struct timespec left;
+	struct timeval tv;
+	int ret;
+
+	if (deadline == NULL)
+		return select(nfds, r, w, x, NULL);
+	simclock_timeout(deadline, &left);
+	tv.tv_sec = left.tv_sec;
+	tv.tv_usec = (left.tv_nsec + 999) / 1000;
+	if (tv.tv_usec == 1000000) {
+		tv.tv_sec++;
+		tv.tv_usec = 0;
+	}
+	ret = select(nfds, r, w, x, &tv);
+	if (ret == 0 && mode == SIMCLOCK_FAST && ts2ns(deadline) > fast_now)
+		fast_now = ts2ns(deadline);
+	return ret;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SIMCLOCK_H_
+#define SIMCLOCK_H_
+
+#include <sys/select.h>
+#include <time.h>
+
+/*
+ * simulation clock, shared by all the emulators. Simulated time is
+ * CLOCK_MONOTONIC based and starts at the real time of simclock_init():
+ * - real: simulated time is real time.
+ * - scaled: simulated time runs <factor> times faster (or slower) than
+ *   real time.
+ * - fast: simulated time only advances when the program waits for it:
+ *   a wait with nothing to do jumps to its deadline at once, so the
+ *   time steps are exactly the ones asked for, whatever the CPU speed.
+ *   The fast clock is not thread safe; it's meant for single-threaded
+ *   programs.
+ * The mode comes from a "real", "fast" or <factor> spec, usually a -c
+ * option, defaulting to the SIMCLOCK_ENV environment variable.
+ */
+#define SIMCLOCK_ENV "BOAT_EMUL_CLOCK"
+
+enum simclock_mode {
+	SIMCLOCK_REAL,
+	SIMCLOCK_SCALED,
+	SIMCLOCK_FAST
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int simclock_init(const char *spec);
+enum simclock_mode simclock_mode(void);
+double simclock_factor(void);
+void simclock_now(struct timespec *);
+void simclock_timeout(const struct timespec *deadline, struct timespec *);
+void simclock_realtime(const struct timespec *deadline, struct timespec *);
+int simclock_select(int, fd_set *, fd_set *, fd_set *,
+    const struct timespec *deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
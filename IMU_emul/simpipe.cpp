@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "simpipe.h"
+
+simpipe::simpipe(double knots) : command(0), offset(0), rot(0)
+{
+	perturb_init(&sea);
+	yawdyn_init(&yaw, knots);
+	last.tv_sec = 0;
+	last.tv_nsec = 0;
+}
+
+simpipe::~simpipe()
+{
+	perturb_free(&sea);
+}
+
+/* a sea_emul wave: 's', 'q' or 'r' and its parameters */
+bool simpipe::add_perturb(int c, const char *arg)
+{
+	return perturb_add(&sea, c, arg) == 0;
+}
+
+/*
+ * advance the loop to when (simulated time) and return the new rate of
+ * turn. Several callers may step to the same time; the loop only moves
+ * forward.
+ */
+double simpipe::step(const struct timespec *when)
+{
+	double dt, theta;
+
+	if (last.tv_sec == 0 && last.tv_nsec == 0) {
+		last = *when;
+		return rot;
+	}
+	dt = (when->tv_sec - last.tv_sec) +
+	    (when->tv_nsec - last.tv_nsec) / 1e9;
+	if (dt <= 0)
+		return rot;
+	last = *when;
+	theta = command.load(std::memory_order_relaxed) +
+	    offset.load(std::memory_order_relaxed) +
+	    perturb_step(&sea, dt);
+	rot = yawdyn_step(&yaw, dt, theta);
+	return rot;
+}
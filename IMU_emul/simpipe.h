@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SIMPIPE_H_
+#define SIMPIPE_H_
+
+#include <time.h>
+#include <atomic>
+#include "perturb.h"
+#include "yawdyn.h"
+
+/*
+ * the sea_emul | rudder2rot | IMU_emul closed loop, in process: each
+ * step adds the sea perturbation to the rudder angle (from the autopilot
+ * and from the user), integrates the yaw dynamics and returns the rate of
+ * turn, without going through pipes and their select() ticks.
+ * The rudder inputs may be set from any thread; step() is called from
+ * the transmit side only.
+ */
+class simpipe {
+    public:
+	simpipe(double knots);
+	~simpipe();
+
+	bool add_perturb(int, const char *);
+	/* rudder reported by the autopilot, in % */
+	inline void set_command(int rudder)
+	    { command.store(yawdyn_rudder(rudder), std::memory_order_relaxed); }
+	/* additional pseudo rudder angle, in rad */
+	inline void set_offset(double rad)
+	    { offset.store(rad, std::memory_order_relaxed); }
+	double step(const struct timespec *when);
+
+    private:
+	struct perturb sea;
+	struct yawdyn yaw;
+	std::atomic<double> command;
+	std::atomic<double> offset;
+	struct timespec last;
+	double rot;
+};
+
+#endif
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <err.h>
+
+#include "simstream.h"
+#include "simclock.h"
+
+/* "text" or "bin", -1 if unknown */
+int
+simstream_format(const char *f)
+{
+	if (strcmp(f, "text") == 0)
+		return 0;
+	if (strcmp(f, "bin") == 0)
+		return 1;
+	return -1;
+}
+
+void
+simstream_init(struct simstream *s, int fd, int binary, int textfield)
+{
+	s->fd = fd;
+	s->binary = binary;
+	s->textfield = textfield;
+	s->hdr = 0;
+	s->len = 0;
+}
+
+/* an empty record at the current simulated time */
+void
+simstream_stamp(struct simstream_rec *rec)
+{
+	struct timespec ts;
+
+	memset(rec, 0, sizeof(*rec));
+	simclock_now(&ts);
+	rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void
+simstream_set(struct simstream_rec *rec, int field, double v)
+{
+	rec->v[field] = v;
+	rec->valid |= 1U << field;
+}
+
+static int
+read_bin(struct simstream *s, simstream_cb cb, void *arg)
+{
+	struct simstream_header h;
+	struct simstream_rec rec;
+	size_t off = 0;
+	int n = 0;
+
+	if (!s->hdr) {
+		if (s->len < sizeof(h))
+			return 0;
+		memcpy(&h, s->buf, sizeof(h));
+		if (memcmp(h.magic, SIMSTREAM_MAGIC, sizeof(h.magic)) != 0 ||
+		    h.order != SIMSTREAM_ORDER || h.recsize != sizeof(rec)) {
+			warnx("bad stream header");
+			return -1;
+		}
+		s->hdr = 1;
+		off = sizeof(h);
+	}
+	while (s->len - off >= sizeof(rec)) {
+		memcpy(&rec, &s->buf[off], sizeof(rec));
+		off += sizeof(rec);
+		(*cb)(&rec, arg);
+		n++;
+	}
+	s->len -= off;
+	memmove(s->buf, &s->buf[off], s->len);
+	return n;
+}
+
+static int
+read_text(struct simstream *s, simstream_cb cb, void *arg)
+{
+	struct simstream_rec rec;
+	char *p, *e, *nl, *line = s->buf;
+	double d;
+	int n = 0, f;
+
+	while ((nl = memchr(line, '\n', s->len - (line - s->buf))) != NULL) {
+		*nl = '\0';
+		simstream_stamp(&rec);
+		p = line;
+		for (f = s->textfield; f < SIMSTREAM_NFIELDS; f++) {
+			d = strtod(p, &e);
+			if (e == p)
+				break;
+			simstream_set(&rec, f, d);
+			p = e;
+		}
+		while (*p == ' ' || *p == '\t' || *p == '\r')
+			p++;
+		if (rec.valid != 0 && *p == '\0') {
+			(*cb)(&rec, arg);
+			n++;
+		}
+		line = nl + 1;
+	}
+	s->len -= line - s->buf;
+	memmove(s->buf, line, s->len);
+	if (s->len == sizeof(s->buf))
+		s->len = 0; /* line too long, drop it */
+	return n;
+}
+
+/*
+ * read what's available from the stream, and call cb for each complete
+ * record or line, in order. Returns the number of records, or -1 on EOF
+ * or error.
+ */
+int
+simstream_read(struct simstream *s, simstream_cb cb, void *arg)
+{
+	ssize_t r;
+
+	r = read(s->fd, &s->buf[s->len], sizeof(s->buf) - s->len);
+	if (r < 0 && errno == EINTR)
+		return 0;
+	if (r <= 0)
+		return -1;
+	s->len += r;
+	if (s->binary)
+		return read_bin(s, cb, arg);
+	return read_text(s, cb, arg);
+}
+
+static int
+writeall(int fd, const void *buf, size_t len)
+{
+	const char *p = buf;
+	ssize_t r;
+
+	while (len > 0) {
+		r = write(fd, p, len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return -1;
+		p += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/* in text mode, only the valid fields from the text field on are written */
+int
+simstream_write(struct simstream *s, const struct simstream_rec *rec)
+{
+	struct simstream_header h;
+	char line[SIMSTREAM_NFIELDS * 32];
+	size_t len = 0;
+	int f;
+
+	if (s->binary) {
+		if (!s->hdr) {
+			memset(&h, 0, sizeof(h));
+			memcpy(h.magic, SIMSTREAM_MAGIC, sizeof(h.magic));
+			h.order = SIMSTREAM_ORDER;
+			h.recsize = sizeof(*rec);
+			if (writeall(s->fd, &h, sizeof(h)) < 0)
+				return -1;
+			s->hdr = 1;
+		}
+		return writeall(s->fd, rec, sizeof(*rec));
+	}
+	for (f = s->textfield; f < SIMSTREAM_NFIELDS &&
+	    (rec->valid & (1U << f)) != 0; f++) {
+		len += snprintf(&line[len], sizeof(line) - len, "%s%f",
+		    len > 0 ? " " : "", rec->v[f]);
+		if (len > sizeof(line) - 2)
+			len = sizeof(line) - 2;
+	}
+	line[len++] = '\n';
+	return writeall(s->fd, line, len);
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef SIMSTREAM_H_
+#define SIMSTREAM_H_
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * sample stream between the emulators (sea_emul | rudder2rot | IMU_emul).
+ * In text mode (the default), a line is one or more numbers for the
+ * consecutive fields starting at the stream's text field; for example
+ * "rot pitch roll" for IMU_emul's input.
+ * In binary mode, the stream starts with a header, followed by fixed size
+ * records: the simulated time of the sample and any of the fields, in
+ * the writer's byte order.
+ */
+#define SIMSTREAM_MAGIC	"N2KSIM01"
+#define SIMSTREAM_ORDER	0x01020304	/* detects a foreign byte order */
+
+struct simstream_header {
+	char magic[8];
+	uint32_t order;
+	uint32_t recsize;	/* sizeof(struct simstream_rec) */
+};
+
+enum simstream_field {
+	SIMSTREAM_RUDDER,	/* (pseudo) rudder angle, rad */
+	SIMSTREAM_ROT,		/* rate of turn, rad/s */
+	SIMSTREAM_PITCH,	/* rad */
+	SIMSTREAM_ROLL,		/* rad */
+	SIMSTREAM_HEADING,	/* rad */
+	SIMSTREAM_NFIELDS
+};
+
+struct simstream_rec {
+	uint64_t ts_ns;		/* simulation clock, ns */
+	uint32_t valid;		/* 1 << field for the fields present */
+	uint32_t pad;
+	double v[SIMSTREAM_NFIELDS];
+};
+
+#define SIMSTREAM_BUFSIZE 4096
+
+struct simstream {
+	int fd;
+	int binary;
+	int textfield;
+	int hdr;	/* binary: header read or written */
+	size_t len;
+	char buf[SIMSTREAM_BUFSIZE];
+};
+
+typedef void (*simstream_cb)(const struct simstream_rec *, void *);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int simstream_format(const char *);
+void simstream_init(struct simstream *, int fd, int binary, int textfield);
+int simstream_read(struct simstream *, simstream_cb, void *);
+int simstream_write(struct simstream *, const struct simstream_rec *);
+void simstream_set(struct simstream_rec *, int, double);
+void simstream_stamp(struct simstream_rec *);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
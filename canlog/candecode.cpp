@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+#include <err.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include "canlog.h"
+#include "canlogz.h"
+#include "nmea2000_defs.h"
+#include "nmea2000_defs_rx.h"
+#include "nmea2000_fields.h"
+
+/*
+ * offline PGN decoder: turns a CAN log into one table per PGN, as CSV
+ * and as binary columns. The log is split in shards decoded in parallel;
+ * a shard owns the fast packets which start in it, and reads past its
+ * end until they are complete, so packets crossing shard boundaries are
+ * reassembled exactly as a sequential decoder would.
+ *
+ * binary columns (.col): a colheader, ncols coldesc, then each column's
+ * nrows values back to back, padded to 8 bytes, in the writer's byte
+ * order. Column types are 'q' int64 (time, ns since the epoch), 'B'
+ * uint8 (source address), 'f' float and 'd' double (NaN when the data
+ * is not available). Values are in SI units (rad, rad/s, m, m/s, s),
+ * except latitudes and longitudes which are in degrees.
+ */
+#define CANDECODE_MAXCOLS 16
+#define CANDECODE_SLOTS	64	/* fast packets being reassembled, per shard */
+#define CANDECODE_TIMEOUT ((uint64_t)NMEA2000_FAST_TIMEOUT * 1000000ULL)
+
+#define COL_MAGIC	"N2KCOL01"
+
+struct colheader {
+	char magic[8];
+	uint32_t order;
+	uint32_t pgn;
+	uint64_t nrows;
+	uint32_t ncols;
+	char name[20];
+};
+
+struct coldesc {
+	char name[15];
+	char type;
+};
+
+struct column {
+	const char *name;
+	char type;
+	int end;	/* payload bytes needed */
+	double (*get)(const uint8_t *);
+	double scale;	/* raw units per unit, a power of 10 */
+};
+
+template <class F> static double
+colget(const uint8_t *d)
+{
+	return F::available(d) ? F::get(d) : NAN;
+}
+
+#define COL(P, f, t)	{ #f, t, P::f::end, colget<P::f>, P::f::scale() }
+#define NCOLS(c)	(sizeof(c) / sizeof(c[0]))
+
+static const column rudder_cols[] = {
+	COL(n2k_rudder_pgn, instance, 'f'),
+	COL(n2k_rudder_pgn, angle_order, 'f'),
+	COL(n2k_rudder_pgn, position, 'f'),
+};
+static const column heading_cols[] = {
+	COL(n2k_heading_pgn, heading, 'f'),
+	COL(n2k_heading_pgn, deviation, 'f'),
+	COL(n2k_heading_pgn, variation, 'f'),
+	COL(n2k_heading_pgn, reference, 'f'),
+};
+static const column rateofturn_cols[] = {
+	COL(n2k_rateofturn_pgn, rate, 'f'),
+};
+static const column attitude_cols[] = {
+	COL(n2k_attitude_pgn, yaw, 'f'),
+	COL(n2k_attitude_pgn, pitch, 'f'),
+	COL(n2k_attitude_pgn, roll, 'f'),
+};
+static const column position_cols[] = {
+	COL(n2k_position_rapid_pgn, latitude, 'd'),
+	COL(n2k_position_rapid_pgn, longitude, 'd'),
+};
+static const column cogsog_cols[] = {
+	COL(n2k_cogsog_pgn, cog, 'f'),
+	COL(n2k_cogsog_pgn, sog, 'f'),
+	COL(n2k_cogsog_pgn, reference, 'f'),
+};
+static const column xte_cols[] = {
+	COL(n2k_xte_pgn, xte, 'f'),
+	COL(n2k_xte_pgn, mode, 'f'),
+};
+static const column navdata_cols[] = {
+	COL(n2k_navdata_pgn, distance, 'd'),
+	COL(n2k_navdata_pgn, bearing_orig, 'f'),
+	COL(n2k_navdata_pgn, bearing_pos, 'f'),
+	COL(n2k_navdata_pgn, dest_wp, 'd'),
+	COL(n2k_navdata_pgn, dest_lat, 'd'),
+	COL(n2k_navdata_pgn, dest_lon, 'd'),
+	COL(n2k_navdata_pgn, closing_speed, 'f'),
+	COL(n2k_navdata_pgn, eta_time, 'd'),
+	COL(n2k_navdata_pgn, eta_date, 'd'),
+};
+
+struct decoder {
+	int pgn;
+	const char *name;
+	bool fast;
+	const column *cols;
+	size_t ncols;
+	bool enabled;
+	int minlen;
+};
+
+static decoder decoders[] = {
+	{ NMEA2000_RUDDER, "rudder", false,
+	    rudder_cols, NCOLS(rudder_cols), false, 0 },
+	{ NMEA2000_HEADING, "heading", false,
+	    heading_cols, NCOLS(heading_cols), false, 0 },
+	{ NMEA2000_RATEOFTURN, "rateofturn", false,
+	    rateofturn_cols, NCOLS(rateofturn_cols), false, 0 },
+	{ NMEA2000_ATTITUDE, "attitude", false,
+	    attitude_cols, NCOLS(attitude_cols), false, 0 },
+	{ NMEA2000_POSITION_RAPID, "position", false,
+	    position_cols, NCOLS(position_cols), false, 0 },
+	{ NMEA2000_COGSOG, "cogsog", false,
+	    cogsog_cols, NCOLS(cogsog_cols), false, 0 },
+	{ NMEA2000_XTE, "xte", false,
+	    xte_cols, NCOLS(xte_cols), false, 0 },
+	{ NMEA2000_NAVDATA, "navdata", true,
+	    navdata_cols, NCOLS(navdata_cols), false, 0 },
+};
+#define NDECODERS	NCOLS(decoders)
+static nmea2000_pgn_index<NDECODERS> pgn_index;
+
+/* the decoded rows of one PGN */
+struct table {
+	std::vector<uint64_t> ts;
+	std::vector<uint8_t> src;
+	std::vector<double> vals;	/* ncols per row */
+};
+
+struct fast_slot {
+	bool inuse;
+	int src;
+	int pgn;
+	int seqid;
+	int next;
+	int len;
+	int got;
+	uint64_t last;
+	uint8_t data[NMEA2000_FAST_MAXLEN];
+};
+
+struct shard {
+	size_t first;	/* first record, or chunk for a chunked log */
+	size_t count;
+	pthread_t thread;
+	std::array<table, NDECODERS> tables;
+	std::array<fast_slot, CANDECODE_SLOTS> slots;
+	int nopen;
+	uint64_t frames, rows, badlen, fast_complete, fast_lost;
+};
+
+static enum { RAW, CHUNKED, MEM } format;
+static canlog_reader rawlog;
+static canlogz_reader zlog;
+static std::vector<struct canlog_rec> memlog;
+static const char *outdir = ".";
+
+static void
+usage(void)
+{
+	std::cerr << "usage: " << getprogname() << " [-j threads] [-o outdir] [-p pgn ...] [-C] [-B] [-q] <logfile>" << std::endl;
+	std::cerr << "       -C: no CSV output, -B: no binary columns" << std::endl;
+	exit(1);
+}
+
+/* sequential access to the log from a shard's first record to the end */
+class cursor {
+    public:
+	cursor(size_t first) : pos(first), recpos(0) {}
+	/* where the last record came from, in the units of shard::first */
+	inline size_t unit() const { return pos - 1; }
+	inline bool next(struct canlog_rec *r)
+	{
+		switch (format) {
+		case RAW:
+			if (pos >= rawlog.size())
+				return false;
+			*r = *rawlog.get(pos++);
+			return true;
+		case MEM:
+			if (pos >= memlog.size())
+				return false;
+			*r = memlog[pos++];
+			return true;
+		case CHUNKED:
+			while (recpos >= recs.size()) {
+				if (pos >= zlog.nchunks())
+					return false;
+				if (!zlog.decode(pos, recs))
+					warnx("chunk %zu corrupted, skipped", pos);
+				pos++;
+				recpos = 0;
+			}
+			*r = recs[recpos++];
+			return true;
+		}
+		return false;
+	}
+    private:
+	size_t pos;
+	std::vector<struct canlog_rec> recs;
+	size_t recpos;
+};
+
+static void
+emit(shard *s, int di, uint64_t ts, int src, const uint8_t *d, int len)
+{
+	const decoder *dec = &decoders[di];
+	table *t = &s->tables[di];
+
+	if (len < dec->minlen) {
+		s->badlen++;
+		return;
+	}
+	t->ts.push_back(ts);
+	t->src.push_back(src);
+	for (size_t c = 0; c < dec->ncols; c++)
+		t->vals.push_back(dec->cols[c].get(d));
+	s->rows++;
+}
+
+static fast_slot *
+slot_lookup(shard *s, int src, int pgn, uint64_t ts)
+{
+	for (size_t i = 0; i < s->slots.size(); i++) {
+		fast_slot *fs = &s->slots[i];
+		if (!fs->inuse || fs->src != src || fs->pgn != pgn)
+			continue;
+		if (ts - fs->last > CANDECODE_TIMEOUT) {
+			fs->inuse = false;
+			s->nopen--;
+			s->fast_lost++;
+			return NULL;
+		}
+		return fs;
+	}
+	return NULL;
+}
+
+static fast_slot *
+slot_alloc(shard *s)
+{
+	fast_slot *fs = NULL;
+
+	for (size_t i = 0; i < s->slots.size(); i++) {
+		if (!s->slots[i].inuse)
+			return &s->slots[i];
+		if (fs == NULL || s->slots[i].last < fs->last)
+			fs = &s->slots[i];
+	}
+	/* all busy: the oldest is probably dead */
+	fs->inuse = false;
+	s->nopen--;
+	s->fast_lost++;
+	return fs;
+}
+
+/*
+ * one fast packet segment. mine is false past the shard's end: then only
+ * the packets already open are continued, new ones belong to the next
+ * shard.
+ */
+static void
+fast_segment(shard *s, int di, const nmea2000_frame &f, uint64_t ts,
+    bool mine, uint64_t shard_start)
+{
+	const uint8_t *d = f.getdata();
+	int dlc = f.getlen();
+	fast_slot *fs;
+	int seqid, cnt, l;
+
+	if (dlc < 2 || dlc > 8)
+		return;
+	seqid = d[0] >> 5;
+	cnt = d[0] & 0x1f;
+	fs = slot_lookup(s, f.getsrc(), f.getpgn(), ts);
+	if (cnt == 0) {
+		if (fs != NULL) {
+			/* previous packet never completed */
+			s->fast_lost++;
+			fs->inuse = false;
+			s->nopen--;
+		}
+		if (!mine || d[1] == 0 || d[1] > NMEA2000_FAST_MAXLEN)
+			return;
+		fs = slot_alloc(s);
+		fs->inuse = true;
+		s->nopen++;
+		fs->src = f.getsrc();
+		fs->pgn = f.getpgn();
+		fs->seqid = seqid;
+		fs->next = 1;
+		fs->len = d[1];
+		l = std::min(std::min(fs->len, 6), dlc - 2);
+		memcpy(fs->data, &d[2], l);
+		fs->got = l;
+	} else {
+		if (fs == NULL) {
+			/*
+			 * start missed; near the start of the shard it may
+			 * be a packet of the previous one, which counts it.
+			 */
+			if (mine && ts - shard_start > CANDECODE_TIMEOUT)
+				s->fast_lost++;
+			return;
+		}
+		if (fs->seqid != seqid || fs->next != cnt) {
+			s->fast_lost++;
+			fs->inuse = false;
+			s->nopen--;
+			return;
+		}
+		l = std::min(fs->len - fs->got, dlc - 1);
+		memcpy(&fs->data[fs->got], &d[1], l);
+		fs->got += l;
+		fs->next++;
+	}
+	fs->last = ts;
+	if (fs->got < fs->len)
+		return;
+	fs->inuse = false;
+	s->nopen--;
+	s->fast_complete++;
+	emit(s, di, ts, fs->src, fs->data, fs->len);
+}
+
+static void *
+decode_shard(void *p)
+{
+	shard *s = (shard *)p;
+	cursor cur(s->first);
+	struct canlog_rec r;
+	nmea2000_frame f(&r.frame);
+	uint64_t start = 0, last = 0;
+	bool mine;
+	int di;
+
+	while (cur.next(&r)) {
+		/* by position: corrupted chunks are skipped */
+		mine = cur.unit() < s->first + s->count;
+		if (mine) {
+			if (s->frames++ == 0)
+				start = r.ts_ns;
+			last = r.ts_ns;
+		} else if (s->nopen == 0 || r.ts_ns > last + CANDECODE_TIMEOUT) {
+			break;
+		}
+		if ((r.frame.can_id & (CAN_EFF_FLAG | CAN_ERR_FLAG)) !=
+		    CAN_EFF_FLAG)
+			continue;
+		if ((di = pgn_index.lookup(f.getpgn())) < 0 ||
+		    !decoders[di].enabled)
+			continue;
+		if (decoders[di].fast)
+			fast_segment(s, di, f, r.ts_ns, mine, start);
+		else if (mine)
+			emit(s, di, r.ts_ns, f.getsrc(), f.getdata(), f.getlen());
+	}
+	/* packets still open at the end of the log, or timed out */
+	s->fast_lost += s->nopen;
+	return NULL;
+}
+
+struct output {
+	int di;
+	const std::vector<shard *> *shards;
+	bool csv, col;
+	bool ok;
+	uint64_t rows;
+	pthread_t thread;
+};
+
+/*
+ * print v, an integer number of 10^-digits units, as a decimal number.
+ * Much faster than printf, and exact: the fields are fixed point.
+ */
+static char *
+fmt_fixed(char *p, int64_t v, int digits)
+{
+	char tmp[24];
+	int n = 0;
+
+	if (v < 0) {
+		*p++ = '-';
+		v = -v;
+	}
+	do {
+		tmp[n++] = '0' + v % 10;
+		v /= 10;
+	} while (v != 0 || n <= digits);
+	while (n > 0) {
+		if (n == digits)
+			*p++ = '.';
+		*p++ = tmp[--n];
+	}
+	return p;
+}
+
+static bool
+write_csv(output *o)
+{
+	const decoder *dec = &decoders[o->di];
+	int digits[CANDECODE_MAXCOLS];
+	char path[1024], line[64 + 24 * CANDECODE_MAXCOLS], *p;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s.csv", outdir, dec->name);
+	if ((fp = fopen(path, "w")) == NULL) {
+		warn("%s", path);
+		return false;
+	}
+	setvbuf(fp, NULL, _IOFBF, CANLOG_BUFSIZE);
+	fprintf(fp, "time,src");
+	for (size_t c = 0; c < dec->ncols; c++) {
+		fprintf(fp, ",%s", dec->cols[c].name);
+		digits[c] = (int)lround(log10(dec->cols[c].scale));
+	}
+	fputc('\n', fp);
+	for (size_t i = 0; i < o->shards->size(); i++) {
+		const table *t = &(*o->shards)[i]->tables[o->di];
+		const double *v = t->vals.empty() ? NULL : &t->vals[0];
+
+		for (size_t r = 0; r < t->ts.size(); r++) {
+			/* time in us, as candump */
+			p = fmt_fixed(line, t->ts[r] / 1000, 6);
+			*p++ = ',';
+			p = fmt_fixed(p, t->src[r], 0);
+			for (size_t c = 0; c < dec->ncols; c++, v++) {
+				*p++ = ',';
+				if (!isnan(*v))
+					p = fmt_fixed(p, llround(*v *
+					    dec->cols[c].scale), digits[c]);
+			}
+			*p++ = '\n';
+			fwrite(line, 1, p - line, fp);
+		}
+	}
+	if (fclose(fp) != 0) {
+		warn("%s", path);
+		return false;
+	}
+	return true;
+}
+
+static bool
+write_col(output *o)
+{
+	const decoder *dec = &decoders[o->di];
+	static const uint8_t pad[8] = { 0 };
+	struct colheader h;
+	struct coldesc cd;
+	std::vector<double> dbuf;
+	std::vector<float> fbuf;
+	char path[1024];
+	size_t c, i, r, len;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/%s.col", outdir, dec->name);
+	if ((fp = fopen(path, "w")) == NULL) {
+		warn("%s", path);
+		return false;
+	}
+	setvbuf(fp, NULL, _IOFBF, CANLOG_BUFSIZE);
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, COL_MAGIC, sizeof(h.magic));
+	h.order = CANLOG_ORDER;
+	h.pgn = dec->pgn;
+	h.nrows = o->rows;
+	h.ncols = dec->ncols + 2;
+	strncpy(h.name, dec->name, sizeof(h.name) - 1);
+	fwrite(&h, sizeof(h), 1, fp);
+	memset(&cd, 0, sizeof(cd));
+	strcpy(cd.name, "time");
+	cd.type = 'q';
+	fwrite(&cd, sizeof(cd), 1, fp);
+	strcpy(cd.name, "src");
+	cd.type = 'B';
+	fwrite(&cd, sizeof(cd), 1, fp);
+	for (c = 0; c < dec->ncols; c++) {
+		memset(&cd, 0, sizeof(cd));
+		strncpy(cd.name, dec->cols[c].name, sizeof(cd.name) - 1);
+		cd.type = dec->cols[c].type;
+		fwrite(&cd, sizeof(cd), 1, fp);
+	}
+	for (i = 0; i < o->shards->size(); i++) {
+		const table *t = &(*o->shards)[i]->tables[o->di];
+		if (!t->ts.empty())
+			fwrite(&t->ts[0], sizeof(t->ts[0]), t->ts.size(), fp);
+	}
+	for (i = 0; i < o->shards->size(); i++) {
+		const table *t = &(*o->shards)[i]->tables[o->di];
+		if (!t->src.empty())
+			fwrite(&t->src[0], 1, t->src.size(), fp);
+	}
+	if (o->rows % 8)
+		fwrite(pad, 1, 8 - o->rows % 8, fp);
+	for (c = 0; c < dec->ncols; c++) {
+		char type = dec->cols[c].type;
+
+		for (i = 0; i < o->shards->size(); i++) {
+			const table *t = &(*o->shards)[i]->tables[o->di];
+			size_t n = t->ts.size();
+
+			/* transpose the shard's rows into the column */
+			if (type == 'd') {
+				dbuf.resize(n);
+				for (r = 0; r < n; r++)
+					dbuf[r] = t->vals[r * dec->ncols + c];
+				if (n > 0)
+					fwrite(&dbuf[0], sizeof(double), n, fp);
+			} else {
+				fbuf.resize(n);
+				for (r = 0; r < n; r++)
+					fbuf[r] = t->vals[r * dec->ncols + c];
+				if (n > 0)
+					fwrite(&fbuf[0], sizeof(float), n, fp);
+			}
+		}
+		len = o->rows * (type == 'd' ? 8 : 4);
+		if (len % 8)
+			fwrite(pad, 1, 8 - len % 8, fp);
+	}
+	if (ferror(fp) || fclose(fp) != 0) {
+		warn("%s", path);
+		return false;
+	}
+	return true;
+}
+
+static void *
+write_output(void *p)
+{
+	output *o = (output *)p;
+
+	o->ok = true;
+	if (o->csv)
+		o->ok = write_csv(o) && o->ok;
+	if (o->col)
+		o->ok = write_col(o) && o->ok;
+	return NULL;
+}
+
+int
+main(int argc, char * const argv[])
+{
+	std::array<decoder *, NDECODERS> decp;
+	std::vector<shard *> shards;
+	std::vector<output> outputs;
+	std::vector<int> pgns;
+	canlog_scan scan;
+	struct canlog_rec r;
+	struct timespec t0, t1, t2;
+	char magic[8];
+	FILE *fp;
+	bool csv = true, col = true, quiet = false, ok = true;
+	long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t total, i, c;
+	uint64_t frames = 0, rows = 0, badlen = 0, complete = 0, lost = 0;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "j:o:p:CBq")) != -1) {
+		switch (ch) {
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		case 'o':
+			outdir = optarg;
+			break;
+		case 'p':
+			pgns.push_back(atoi(optarg));
+			break;
+		case 'C':
+			csv = false;
+			break;
+		case 'B':
+			col = false;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1 || nthreads < 1)
+		usage();
+
+	for (i = 0; i < NDECODERS; i++) {
+		decoder *d = &decoders[i];
+
+		d->enabled = pgns.empty() ||
+		    std::find(pgns.begin(), pgns.end(), d->pgn) != pgns.end();
+		if (d->ncols > CANDECODE_MAXCOLS)
+			errx(1, "%s: too many columns", d->name);
+		d->minlen = 0;
+		for (c = 0; c < d->ncols; c++)
+			d->minlen = std::max(d->minlen, d->cols[c].end);
+		decp[i] = d;
+	}
+	pgn_index.build(decp);
+	if (mkdir(outdir, 0755) < 0 && errno != EEXIST)
+		err(1, "%s", outdir);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	/* binary logs are shared by the shards, text ones loaded in memory */
+	if ((fp = fopen(argv[0], "r")) == NULL)
+		err(1, "%s", argv[0]);
+	memset(magic, 0, sizeof(magic));
+	(void)fread(magic, 1, sizeof(magic), fp);
+	fclose(fp);
+	if (memcmp(magic, CANLOG_MAGIC, sizeof(magic)) == 0) {
+		format = RAW;
+		if (!rawlog.open(argv[0]))
+			exit(1);
+		total = rawlog.size();
+	} else if (memcmp(magic, CANLOGZ_MAGIC, sizeof(magic)) == 0) {
+		format = CHUNKED;
+		if (!zlog.open(argv[0]))
+			exit(1);
+		total = zlog.nchunks();
+	} else {
+		format = MEM;
+		if (!scan.open(argv[0]))
+			exit(1);
+		while (scan.next(&r))
+			memlog.push_back(r);
+		total = memlog.size();
+	}
+	if ((size_t)nthreads > total)
+		nthreads = total > 0 ? total : 1;
+
+	for (i = 0; i < (size_t)nthreads; i++) {
+		shard *s = new shard();
+
+		s->first = total * i / nthreads;
+		s->count = total * (i + 1) / nthreads - s->first;
+		shards.push_back(s);
+		if (pthread_create(&s->thread, NULL, decode_shard, s) != 0)
+			errx(1, "can't create decoder thread");
+	}
+	for (i = 0; i < shards.size(); i++) {
+		pthread_join(shards[i]->thread, NULL);
+		frames += shards[i]->frames;
+		rows += shards[i]->rows;
+		badlen += shards[i]->badlen;
+		complete += shards[i]->fast_complete;
+		lost += shards[i]->fast_lost;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	/* one writer per PGN */
+	outputs.resize(NDECODERS);
+	for (i = 0; i < NDECODERS; i++) {
+		output *o = &outputs[i];
+
+		o->di = i;
+		o->shards = &shards;
+		o->csv = csv;
+		o->col = col;
+		o->ok = true;
+		o->rows = 0;
+		for (c = 0; c < shards.size(); c++)
+			o->rows += shards[c]->tables[i].ts.size();
+		if (o->rows == 0)
+			continue;
+		if (pthread_create(&o->thread, NULL, write_output, o) != 0)
+			errx(1, "can't create writer thread");
+	}
+	for (i = 0; i < NDECODERS; i++) {
+		if (outputs[i].rows == 0)
+			continue;
+		pthread_join(outputs[i].thread, NULL);
+		ok = ok && outputs[i].ok;
+		if (!quiet) {
+			std::cerr << decoders[i].name << " (" << decoders[i].pgn
+			    << "): " << outputs[i].rows << " rows" << std::endl;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+	if (!quiet) {
+		std::cerr << frames << " frames, " << rows << " rows, "
+		    << badlen << " too short; fast packets: " << complete
+		    << " complete, " << lost << " lost" << std::endl;
+		std::cerr << shards.size() << " shards, decoded in "
+		    << (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9
+		    << "s, written in "
+		    << (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9
+		    << "s" << std::endl;
+	}
+	exit(ok ? 0 : 1);
+}
@@ -0,0 +1,321 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <err.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <net/if.h>
+#include "canlog.h"
+
+int
+canlog_socket(const char *ifname)
+{
+	struct ifreq ifr;
+	struct sockaddr_can addr;
+	int s;
+
+	if ((s = socket(PF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
+		warn("CAN socket");
+		return -1;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, ifname, sizeof(ifr.ifr_name) - 1);
+	if (ioctl(s, SIOCGIFINDEX, &ifr) < 0) {
+		warn("can't get index for CAN interface %s", ifname);
+		::close(s);
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = ifr.ifr_ifindex;
+	if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+		warn("can't bind CAN socket to %s", ifname);
+		::close(s);
+		return -1;
+	}
+	return s;
+}
+
+uint64_t
+canlog_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+canlog_writer::canlog_writer()
+{
+	fd = -1;
+	memset(bufs, 0, sizeof(bufs));
+	memset(lens, 0, sizeof(lens));
+	cur = head = nfull = 0;
+	running = error = false;
+	nrecs = noverruns = 0;
+	pthread_mutex_init(&mtx, NULL);
+	pthread_cond_init(&cv, NULL);
+}
+
+canlog_writer::~canlog_writer()
+{
+	close();
+	for (int i = 0; i < CANLOG_NBUF; i++)
+		free(bufs[i]);
+	pthread_cond_destroy(&cv);
+	pthread_mutex_destroy(&mtx);
+}
+
+bool
+canlog_writer::open(const char *path, const char *canif, uint64_t start_ns)
+{
+	struct canlog_header h;
+
+	for (int i = 0; i < CANLOG_NBUF; i++) {
+		if (bufs[i] == NULL &&
+		    (bufs[i] = (uint8_t *)malloc(CANLOG_BUFSIZE)) == NULL) {
+			warn("malloc");
+			return false;
+		}
+	}
+	if ((fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+		warn("%s", path);
+		return false;
+	}
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CANLOG_MAGIC, sizeof(h.magic));
+	h.order = CANLOG_ORDER;
+	h.recsize = sizeof(struct canlog_rec);
+	strncpy(h.canif, canif, sizeof(h.canif) - 1);
+	h.start_ns = start_ns != 0 ? start_ns : canlog_now();
+	/* the header goes through the buffers too, to keep writes ordered */
+	memcpy(bufs[cur], &h, sizeof(h));
+	lens[cur] = sizeof(h);
+	running = true;
+	if (pthread_create(&thread, NULL, writer_thread, this) != 0) {
+		warnx("can't create writer thread");
+		running = false;
+		return false;
+	}
+	return true;
+}
+
+/* queue the current buffer and switch to the next one; mtx held */
+void
+canlog_writer::push()
+{
+	if (lens[cur] == 0)
+		return;
+	if (nfull == CANLOG_NBUF - 1) {
+		/* the disk doesn't keep up; wait rather than lose frames */
+		noverruns++;
+		while (nfull == CANLOG_NBUF - 1 && running)
+			pthread_cond_wait(&cv, &mtx);
+	}
+	nfull++;
+	cur = (cur + 1) % CANLOG_NBUF;
+	lens[cur] = 0;
+	pthread_cond_broadcast(&cv);
+}
+
+void
+canlog_writer::put(const struct canlog_rec *r)
+{
+	if (lens[cur] + sizeof(*r) > CANLOG_BUFSIZE) {
+		pthread_mutex_lock(&mtx);
+		push();
+		pthread_mutex_unlock(&mtx);
+	}
+	memcpy(&bufs[cur][lens[cur]], r, sizeof(*r));
+	lens[cur] += sizeof(*r);
+	nrecs++;
+}
+
+void
+canlog_writer::add(uint64_t ts_ns, const struct can_frame *cf)
+{
+	struct canlog_rec r;
+
+	r.ts_ns = ts_ns;
+	memset(&r.frame, 0, sizeof(r.frame));
+	r.frame.can_id = cf->can_id;
+	r.frame.can_dlc = cf->can_dlc;
+	memcpy(r.frame.data, cf->data, sizeof(r.frame.data));
+	put(&r);
+}
+
+void
+canlog_writer::mark(uint32_t what, uint32_t value)
+{
+	struct canlog_rec r;
+
+	memset(&r, 0, sizeof(r));
+	r.ts_ns = canlog_now();
+	r.frame.can_id = CAN_ERR_FLAG | what;
+	r.frame.can_dlc = 4;
+	memcpy(r.frame.data, &value, sizeof(value));
+	put(&r);
+}
+
+void
+canlog_writer::flush()
+{
+	pthread_mutex_lock(&mtx);
+	push();
+	pthread_mutex_unlock(&mtx);
+}
+
+/* write out everything queued and stop the writer; false on write error */
+bool
+canlog_writer::close()
+{
+	if (fd < 0)
+		return !error;
+	pthread_mutex_lock(&mtx);
+	push();
+	running = false;
+	pthread_cond_broadcast(&cv);
+	pthread_mutex_unlock(&mtx);
+	pthread_join(thread, NULL);
+	if (::close(fd) < 0) {
+		warn("close");
+		error = true;
+	}
+	fd = -1;
+	return !error;
+}
+
+void *
+canlog_writer::writer_thread(void *p)
+{
+	canlog_writer *w = (canlog_writer *)p;
+	const uint8_t *b;
+	size_t len;
+	ssize_t r;
+
+	pthread_mutex_lock(&w->mtx);
+	for (;;) {
+		while (w->nfull == 0 && w->running)
+			pthread_cond_wait(&w->cv, &w->mtx);
+		if (w->nfull == 0)
+			break;
+		b = w->bufs[w->head];
+		len = w->lens[w->head];
+		pthread_mutex_unlock(&w->mtx);
+		while (len > 0 && !w->error) {
+			r = write(w->fd, b, len);
+			if (r < 0) {
+				if (errno == EINTR)
+					continue;
+				warn("write log");
+				w->error = true;
+				break;
+			}
+			b += r;
+			len -= r;
+		}
+		pthread_mutex_lock(&w->mtx);
+		w->head = (w->head + 1) % CANLOG_NBUF;
+		w->nfull--;
+		pthread_cond_broadcast(&w->cv);
+	}
+	pthread_mutex_unlock(&w->mtx);
+	return NULL;
+}
+
+canlog_reader::canlog_reader()
+{
+	map = NULL;
+	maplen = 0;
+	hdr = NULL;
+	recs = NULL;
+	nrecs = 0;
+}
+
+canlog_reader::~canlog_reader()
+{
+	close();
+}
+
+bool
+canlog_reader::open(const char *path)
+{
+	struct stat st;
+	int fd;
+
+	if ((fd = ::open(path, O_RDONLY)) < 0) {
+		warn("%s", path);
+		return false;
+	}
+	if (fstat(fd, &st) < 0) {
+		warn("%s", path);
+		::close(fd);
+		return false;
+	}
+	if ((size_t)st.st_size < sizeof(struct canlog_header)) {
+		warnx("%s: not a CAN log", path);
+		::close(fd);
+		return false;
+	}
+	maplen = st.st_size;
+	map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		warn("mmap %s", path);
+		map = NULL;
+		return false;
+	}
+	hdr = (const struct canlog_header *)map;
+	if (memcmp(hdr->magic, CANLOG_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->order != CANLOG_ORDER ||
+	    hdr->recsize != sizeof(struct canlog_rec)) {
+		warnx("%s: not a CAN log, or from a different host type",
+		    path);
+		close();
+		return false;
+	}
+	madvise(map, maplen, MADV_SEQUENTIAL);
+	recs = (const struct canlog_rec *)(hdr + 1);
+	nrecs = (maplen - sizeof(*hdr)) / sizeof(struct canlog_rec);
+	return true;
+}
+
+void
+canlog_reader::close()
+{
+	if (map != NULL)
+		munmap(map, maplen);
+	map = NULL;
+	hdr = NULL;
+	recs = NULL;
+	nrecs = 0;
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CANLOG_H_
+#define CANLOG_H_
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include "nmea2000_frame.h"
+
+/*
+ * raw CAN log: a header followed by fixed size records, each a receive
+ * time and the can_frame as the kernel gave it, in the recording host's
+ * byte order. The file is only ever appended to; a truncated last record
+ * (recorder killed) is ignored by the reader.
+ */
+#define CANLOG_MAGIC	"N2KRAW01"
+#define CANLOG_ORDER	0x01020304	/* detects a foreign byte order */
+
+struct canlog_header {
+	char magic[8];
+	uint32_t order;
+	uint32_t recsize;	/* sizeof(struct canlog_rec) */
+	char canif[16];
+	uint64_t start_ns;	/* CLOCK_REALTIME when the recording started */
+};
+
+struct canlog_rec {
+	uint64_t ts_ns;		/* CLOCK_REALTIME, ns */
+	struct can_frame frame;
+};
+
+/*
+ * marker records are error frames (CAN_ERR_FLAG) with one of these ids;
+ * they are never replayed.
+ */
+#define CANLOG_MARK_DROPS	0x01	/* data[0-3]: frames lost by the kernel */
+
+#define CANLOG_BUFSIZE	(1024 * 1024)	/* write size */
+#define CANLOG_NBUF	16		/* buffers queued to the writer */
+
+/* open a raw CAN socket bound to ifname, -1 (with a warning) on error */
+int canlog_socket(const char *ifname);
+/* CLOCK_REALTIME as ns */
+uint64_t canlog_now(void);
+
+/*
+ * buffered log writer: records are copied into large buffers which a
+ * separate thread writes out, so a slow disk never stalls the receive
+ * loop (unless all CANLOG_NBUF buffers are waiting, then add() blocks
+ * and the overruns are counted).
+ */
+class canlog_writer {
+    public:
+	canlog_writer();
+	~canlog_writer();
+
+	/* start_ns is the recording start time in the header, 0 for now */
+	bool open(const char *path, const char *canif, uint64_t start_ns = 0);
+	void add(uint64_t ts_ns, const struct can_frame *);
+	void mark(uint32_t what, uint32_t value);
+	void flush();	/* hand the current buffer to the writer now */
+	bool close();
+
+	inline uint64_t records() const { return nrecs; }
+	inline uint64_t overruns() const { return noverruns; }
+
+    private:
+	int fd;
+	uint8_t *bufs[CANLOG_NBUF];
+	size_t lens[CANLOG_NBUF];
+	int cur;	/* buffer being filled */
+	int head;	/* next buffer to write */
+	int nfull;	/* buffers waiting for the writer */
+	bool running;
+	bool error;
+	uint64_t nrecs;
+	uint64_t noverruns;
+	pthread_t thread;
+	pthread_mutex_t mtx;
+	pthread_cond_t cv;
+
+	void put(const struct canlog_rec *);
+	void push();
+	static void *writer_thread(void *);
+};
+
+/* log reader: the file is mapped, records are accessed in place */
+class canlog_reader {
+    public:
+	canlog_reader();
+	~canlog_reader();
+
+	bool open(const char *path);
+	void close();
+
+	inline const struct canlog_header *header() const { return hdr; }
+	inline size_t size() const { return nrecs; }
+	inline const struct canlog_rec *get(size_t i) const
+	    { return &recs[i]; }
+	static inline bool is_mark(const struct canlog_rec *r)
+	    { return (r->frame.can_id & CAN_ERR_FLAG) != 0; }
+
+    private:
+	void *map;
+	size_t maplen;
+	const struct canlog_header *hdr;
+	const struct canlog_rec *recs;
+	size_t nrecs;
+};
+
+#endif
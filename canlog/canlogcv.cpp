@@ -0,0 +1,168 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+#include <iostream>
+#include <vector>
+#include "canlog.h"
+#include "canlogz.h"
+
+/*
+ * convert between the CAN log formats (raw from canrec, chunked, and
+ * candump -l text), optionally keeping only a time range and some PGNs.
+ */
+
+static void
+usage(void)
+{
+	std::cerr << "usage: " << getprogname() << " [-o chunked|raw|candump] [-b from] [-e to] [-p pgn ...] [-q] <in> <out>" << std::endl;
+	std::cerr << "       from and to are seconds since the epoch, or +seconds from the start" << std::endl;
+	std::cerr << "       in or out - is candump text on stdin or stdout" << std::endl;
+	exit(1);
+}
+
+int
+main(int argc, char * const argv[])
+{
+	enum { CHUNKED, RAW, CANDUMP } oformat = CHUNKED;
+	const char *from_s = NULL, *to_s = NULL;
+	std::vector<int> pgns;
+	canlog_scan in;
+	canlog_writer rawout;
+	canlogz_writer zout;
+	FILE *textout = NULL;
+	struct canlog_rec r;
+	uint64_t from = 0, to = UINT64_MAX, n = 0;
+	bool quiet = false, ok = true;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "o:b:e:p:q")) != -1) {
+		switch (ch) {
+		case 'o':
+			if (strcmp(optarg, "chunked") == 0)
+				oformat = CHUNKED;
+			else if (strcmp(optarg, "raw") == 0)
+				oformat = RAW;
+			else if (strcmp(optarg, "candump") == 0)
+				oformat = CANDUMP;
+			else
+				usage();
+			break;
+		case 'b':
+			from_s = optarg;
+			break;
+		case 'e':
+			to_s = optarg;
+			break;
+		case 'p':
+			pgns.push_back(atoi(optarg));
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+		usage();
+	if (strcmp(argv[1], "-") == 0 && oformat != CANDUMP)
+		usage();
+
+	if (!in.open(argv[0]))
+		exit(1);
+	if ((from_s != NULL &&
+	    !canlog_scan::parse_time(from_s, in.start_ns(), &from)) ||
+	    (to_s != NULL &&
+	    !canlog_scan::parse_time(to_s, in.start_ns(), &to)))
+		usage();
+	in.set_range(from, to);
+	in.set_pgns(pgns);
+
+	switch (oformat) {
+	case CHUNKED:
+		ok = zout.open(argv[1], in.canif(), in.start_ns());
+		break;
+	case RAW:
+		ok = rawout.open(argv[1], in.canif(), in.start_ns());
+		break;
+	case CANDUMP:
+		if (strcmp(argv[1], "-") == 0)
+			textout = stdout;
+		else if ((textout = fopen(argv[1], "w")) == NULL)
+			warn("%s", argv[1]);
+		ok = (textout != NULL);
+		break;
+	}
+	if (!ok)
+		exit(1);
+
+	while (in.next(&r)) {
+		switch (oformat) {
+		case CHUNKED:
+			zout.add(&r);
+			break;
+		case RAW:
+			rawout.add(r.ts_ns, &r.frame);
+			break;
+		case CANDUMP:
+			canlog_scan::print_candump(textout, &r, in.canif());
+			break;
+		}
+		n++;
+	}
+
+	switch (oformat) {
+	case CHUNKED:
+		ok = zout.close();
+		break;
+	case RAW:
+		ok = rawout.close();
+		break;
+	case CANDUMP:
+		if (fflush(textout) != 0 || ferror(textout)) {
+			warn("%s", argv[1]);
+			ok = false;
+		}
+		if (textout != stdout)
+			fclose(textout);
+		break;
+	}
+	if (!quiet) {
+		std::cerr << n << " frames";
+		if (in.chunks_read() > 0)
+			std::cerr << ", " << in.chunks_read()
+			    << " chunks decompressed";
+		std::cerr << std::endl;
+	}
+	exit(ok ? 0 : 1);
+}
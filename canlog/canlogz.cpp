@@ -0,0 +1,679 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <algorithm>
+#include "canlogz.h"
+
+#define ALIGN8(x)	(((x) + 7) & ~(uint64_t)7)
+
+static inline void
+put_varint(std::vector<uint8_t> &v, uint64_t x)
+{
+	while (x >= 0x80) {
+		v.push_back((x & 0x7f) | 0x80);
+		x >>= 7;
+	}
+	v.push_back(x);
+}
+
+static inline bool
+get_varint(const uint8_t **p, const uint8_t *end, uint64_t *x)
+{
+	int shift = 0;
+
+	*x = 0;
+	while (*p < end && shift < 64) {
+		uint8_t b = *(*p)++;
+		*x |= (uint64_t)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+			return true;
+		shift += 7;
+	}
+	return false;
+}
+
+static inline uint64_t
+zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t
+unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/* the PGN of a NMEA2000 frame, -1 for other frames and log markers */
+static inline int
+rec_pgn(const struct canlog_rec *r)
+{
+	nmea2000_frame f((struct can_frame *)&r->frame);
+
+	if ((r->frame.can_id & (CAN_EFF_FLAG | CAN_ERR_FLAG)) != CAN_EFF_FLAG)
+		return -1;
+	return f.getpgn();
+}
+
+canlogz_writer::canlogz_writer()
+{
+	fp = NULL;
+	offset = nrecs = 0;
+	error = false;
+	chunk_nrecs = 0;
+}
+
+canlogz_writer::~canlogz_writer()
+{
+	close();
+}
+
+bool
+canlogz_writer::open(const char *path, const char *canif, uint64_t start_ns)
+{
+	struct canlogz_header h;
+
+	if ((fp = fopen(path, "w")) == NULL) {
+		warn("%s", path);
+		return false;
+	}
+	setvbuf(fp, NULL, _IOFBF, CANLOG_BUFSIZE);
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CANLOGZ_MAGIC, sizeof(h.magic));
+	h.order = CANLOG_ORDER;
+	h.chunk_recs = CANLOGZ_CHUNK_RECS;
+	strncpy(h.canif, canif, sizeof(h.canif) - 1);
+	h.start_ns = start_ns;
+	put(&h, sizeof(h));
+	return !error;
+}
+
+void
+canlogz_writer::put(const void *p, size_t len)
+{
+	if (!error && fwrite(p, 1, len, fp) != len) {
+		warn("write log");
+		error = true;
+	}
+	offset += len;
+}
+
+void
+canlogz_writer::add(const struct canlog_rec *r)
+{
+	int dlc = r->frame.can_dlc & 0x0f;
+	uint8_t flags = dlc;
+	int pgn;
+
+	if (chunk_nrecs == 0) {
+		raw.clear();
+		chunk_pgns.clear();
+		t_start = t_first = t_last = t_prev = r->ts_ns;
+		id_prev = 0;
+	} else if (r->frame.can_id == id_prev) {
+		flags |= CANLOGZ_SAMEID;
+	}
+	raw.push_back(flags);
+	put_varint(raw, zigzag((int64_t)(r->ts_ns - t_prev)));
+	if ((flags & CANLOGZ_SAMEID) == 0)
+		put_varint(raw, zigzag((int32_t)(r->frame.can_id - id_prev)));
+	raw.insert(raw.end(), r->frame.data,
+	    r->frame.data + std::min(dlc, CAN_MAX_DLEN));
+	t_prev = r->ts_ns;
+	id_prev = r->frame.can_id;
+	t_first = std::min(t_first, r->ts_ns);
+	t_last = std::max(t_last, r->ts_ns);
+	if ((pgn = rec_pgn(r)) >= 0 &&
+	    (chunk_pgns.empty() || chunk_pgns.back() != (uint32_t)pgn))
+		chunk_pgns.push_back(pgn);
+	nrecs++;
+	if (++chunk_nrecs == CANLOGZ_CHUNK_RECS)
+		write_chunk();
+}
+
+void
+canlogz_writer::write_chunk()
+{
+	struct canlogz_chunk c;
+	struct canlogz_index ix;
+	uLongf clen;
+	static const uint8_t pad[8] = { 0 };
+
+	if (chunk_nrecs == 0)
+		return;
+	comp.resize(compressBound(raw.size()));
+	clen = comp.size();
+	if (compress2(&comp[0], &clen, &raw[0], raw.size(),
+	    Z_DEFAULT_COMPRESSION) != Z_OK) {
+		warnx("compress2 failed");
+		error = true;
+		return;
+	}
+	std::sort(chunk_pgns.begin(), chunk_pgns.end());
+	chunk_pgns.erase(std::unique(chunk_pgns.begin(), chunk_pgns.end()),
+	    chunk_pgns.end());
+
+	ix.offset = offset;
+	ix.t_first = t_first;
+	ix.t_last = t_last;
+	ix.nrecs = chunk_nrecs;
+	ix.npgns = chunk_pgns.size();
+	ix.pgn_first = pgns.size();
+	index.push_back(ix);
+	pgns.insert(pgns.end(), chunk_pgns.begin(), chunk_pgns.end());
+
+	c.magic = CANLOGZ_CHUNK_MAGIC;
+	c.nrecs = chunk_nrecs;
+	c.rawlen = raw.size();
+	c.complen = clen;
+	c.t_start = t_start;
+	c.t_first = t_first;
+	c.t_last = t_last;
+	put(&c, sizeof(c));
+	put(&comp[0], clen);
+	/* keep the structures aligned */
+	put(pad, ALIGN8(clen) - clen);
+	chunk_nrecs = 0;
+}
+
+/* write the last chunk and the index; false if anything failed */
+bool
+canlogz_writer::close()
+{
+	struct canlogz_trailer t;
+
+	if (fp == NULL)
+		return !error;
+	write_chunk();
+	memset(&t, 0, sizeof(t));
+	t.index_off = offset;
+	t.nchunks = index.size();
+	t.npgns = pgns.size();
+	memcpy(t.magic, CANLOGZ_IDX_MAGIC, sizeof(t.magic));
+	if (!index.empty())
+		put(&index[0], index.size() * sizeof(index[0]));
+	if (!pgns.empty())
+		put(&pgns[0], pgns.size() * sizeof(pgns[0]));
+	if (pgns.size() & 1)
+		put(&t, 4);	/* pad; the trailer has 64 bit fields */
+	put(&t, sizeof(t));
+	if (fclose(fp) != 0 && !error) {
+		warn("close log");
+		error = true;
+	}
+	fp = NULL;
+	return !error;
+}
+
+canlogz_reader::canlogz_reader()
+{
+	map = NULL;
+	maplen = 0;
+	hdr = NULL;
+	idx = NULL;
+	nidx = 0;
+	pgns = NULL;
+	npgns = 0;
+}
+
+canlogz_reader::~canlogz_reader()
+{
+	close();
+}
+
+bool
+canlogz_reader::open(const char *path)
+{
+	const struct canlogz_trailer *t;
+	const struct canlogz_chunk *c;
+	struct canlogz_index ix;
+	struct stat st;
+	uint64_t off;
+	int fd;
+
+	if ((fd = ::open(path, O_RDONLY)) < 0) {
+		warn("%s", path);
+		return false;
+	}
+	if (fstat(fd, &st) < 0 ||
+	    (size_t)st.st_size < sizeof(struct canlogz_header)) {
+		warnx("%s: not a chunked CAN log", path);
+		::close(fd);
+		return false;
+	}
+	maplen = st.st_size;
+	map = mmap(NULL, maplen, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED) {
+		warn("mmap %s", path);
+		map = NULL;
+		return false;
+	}
+	hdr = (const struct canlogz_header *)map;
+	if (memcmp(hdr->magic, CANLOGZ_MAGIC, sizeof(hdr->magic)) != 0 ||
+	    hdr->order != CANLOG_ORDER) {
+		warnx("%s: not a chunked CAN log, or from a different host type",
+		    path);
+		close();
+		return false;
+	}
+
+	if (maplen >= sizeof(*hdr) + sizeof(*t)) {
+		t = (const struct canlogz_trailer *)
+		    ((const char *)map + maplen - sizeof(*t));
+		if (memcmp(t->magic, CANLOGZ_IDX_MAGIC, sizeof(t->magic)) == 0 &&
+		    t->index_off + (uint64_t)t->nchunks * sizeof(*idx) +
+		    ALIGN8((uint64_t)t->npgns * sizeof(*pgns)) +
+		    sizeof(*t) == maplen) {
+			idx = (const struct canlogz_index *)
+			    ((const char *)map + t->index_off);
+			nidx = t->nchunks;
+			pgns = (const uint32_t *)(idx + nidx);
+			npgns = t->npgns;
+			return true;
+		}
+	}
+
+	/* no index: walk the chunks */
+	for (off = sizeof(*hdr); off + sizeof(*c) <= maplen;
+	    off += sizeof(*c) + ALIGN8(c->complen)) {
+		c = (const struct canlogz_chunk *)((const char *)map + off);
+		if (c->magic != CANLOGZ_CHUNK_MAGIC ||
+		    off + sizeof(*c) + c->complen > maplen)
+			break;
+		ix.offset = off;
+		ix.t_first = c->t_first;
+		ix.t_last = c->t_last;
+		ix.nrecs = c->nrecs;
+		ix.npgns = CANLOGZ_NOPGNS;
+		ix.pgn_first = 0;
+		rebuilt.push_back(ix);
+	}
+	warnx("%s: no index, %zu chunks found", path, rebuilt.size());
+	idx = rebuilt.empty() ? NULL : &rebuilt[0];
+	nidx = rebuilt.size();
+	return true;
+}
+
+void
+canlogz_reader::close()
+{
+	if (map != NULL)
+		munmap(map, maplen);
+	map = NULL;
+	hdr = NULL;
+	idx = NULL;
+	nidx = 0;
+	pgns = NULL;
+	npgns = 0;
+	rebuilt.clear();
+}
+
+bool
+canlogz_reader::has_pgn(size_t i, int pgn) const
+{
+	const uint32_t *p;
+
+	if (idx[i].npgns == CANLOGZ_NOPGNS)
+		return true;
+	if (idx[i].pgn_first + idx[i].npgns > npgns)
+		return false;
+	p = pgns + idx[i].pgn_first;
+	return std::binary_search(p, p + idx[i].npgns, (uint32_t)pgn);
+}
+
+bool
+canlogz_reader::decode(size_t i, std::vector<struct canlog_rec> &out) const
+{
+	const struct canlogz_chunk *c;
+	std::vector<uint8_t> raw;
+	const uint8_t *p, *end;
+	struct canlog_rec r;
+	uint64_t ts, v;
+	uint32_t id = 0;
+	uLongf rawlen;
+	int dlc;
+
+	out.clear();
+	/* the index may be as corrupted as the chunks */
+	if (idx[i].offset > maplen - sizeof(*c))
+		return false;
+	c = (const struct canlogz_chunk *)((const char *)map + idx[i].offset);
+	if (c->magic != CANLOGZ_CHUNK_MAGIC || c->rawlen == 0 ||
+	    c->complen > maplen - sizeof(*c) - idx[i].offset)
+		return false;
+	raw.resize(c->rawlen);
+	rawlen = c->rawlen;
+	if (uncompress(&raw[0], &rawlen, (const Bytef *)(c + 1),
+	    c->complen) != Z_OK || rawlen != c->rawlen)
+		return false;
+	out.reserve(c->nrecs);
+	ts = c->t_start;
+	p = &raw[0];
+	end = p + rawlen;
+	memset(&r, 0, sizeof(r));
+	while (p < end) {
+		uint8_t flags = *p++;
+
+		dlc = flags & 0x0f;
+		if (!get_varint(&p, end, &v))
+			goto bad;
+		ts += unzigzag(v);
+		if ((flags & CANLOGZ_SAMEID) == 0) {
+			if (!get_varint(&p, end, &v))
+				goto bad;
+			id += (uint32_t)unzigzag(v);
+		}
+		if (p + std::min(dlc, CAN_MAX_DLEN) > end)
+			goto bad;
+		r.ts_ns = ts;
+		r.frame.can_id = id;
+		r.frame.can_dlc = dlc;
+		memset(r.frame.data, 0, sizeof(r.frame.data));
+		memcpy(r.frame.data, p, std::min(dlc, CAN_MAX_DLEN));
+		p += std::min(dlc, CAN_MAX_DLEN);
+		out.push_back(r);
+	}
+	if (out.size() == c->nrecs)
+		return true;
+bad:
+	out.clear();
+	return false;
+}
+
+canlog_scan::canlog_scan()
+{
+	format = RAW;
+	text = NULL;
+	memset(ifname, 0, sizeof(ifname));
+	start = 0;
+	from = 0;
+	to = UINT64_MAX;
+	pos = recpos = 0;
+	have_peek = false;
+	nread = 0;
+}
+
+bool
+canlog_scan::open(const char *path)
+{
+	char magic[8];
+	int fd;
+
+	memset(magic, 0, sizeof(magic));
+	if (strcmp(path, "-") == 0) {
+		text = stdin;
+	} else {
+		if ((fd = ::open(path, O_RDONLY)) < 0) {
+			warn("%s", path);
+			return false;
+		}
+		(void)read(fd, magic, sizeof(magic));
+		::close(fd);
+	}
+	if (memcmp(magic, CANLOG_MAGIC, sizeof(magic)) == 0) {
+		format = RAW;
+		if (!rawlog.open(path))
+			return false;
+		memcpy(ifname, rawlog.header()->canif, sizeof(ifname) - 1);
+		start = rawlog.header()->start_ns;
+	} else if (memcmp(magic, CANLOGZ_MAGIC, sizeof(magic)) == 0) {
+		format = CHUNKED;
+		if (!zlog.open(path))
+			return false;
+		memcpy(ifname, zlog.header()->canif, sizeof(ifname) - 1);
+		start = zlog.header()->start_ns;
+	} else {
+		format = CANDUMP;
+		if (text == NULL && (text = fopen(path, "r")) == NULL) {
+			warn("%s", path);
+			return false;
+		}
+		/* the start is the first frame's time */
+		if (!next_unfiltered(&peek)) {
+			warnx("%s: no CAN frames", path);
+			return false;
+		}
+		have_peek = true;
+		start = peek.ts_ns;
+	}
+	return true;
+}
+
+void
+canlog_scan::set_range(uint64_t f, uint64_t t)
+{
+	from = f;
+	to = t;
+}
+
+void
+canlog_scan::set_pgns(const std::vector<int> &p)
+{
+	pgns = p;
+	std::sort(pgns.begin(), pgns.end());
+}
+
+bool
+canlog_scan::selected(const struct canlog_rec *r) const
+{
+	if (r->ts_ns < from || r->ts_ns > to)
+		return false;
+	if (!pgns.empty() &&
+	    !std::binary_search(pgns.begin(), pgns.end(), rec_pgn(r)))
+		return false;
+	return true;
+}
+
+bool
+canlog_scan::next_unfiltered(struct canlog_rec *r)
+{
+	char line[256];
+
+	switch (format) {
+	case RAW:
+		if (pos >= rawlog.size())
+			return false;
+		*r = *rawlog.get(pos++);
+		return true;
+	case CHUNKED:
+		while (recpos >= recs.size()) {
+			/* the next chunk which may have what we want */
+			for (; pos < zlog.nchunks(); pos++) {
+				const struct canlogz_index *ix = zlog.chunk(pos);
+				bool match = pgns.empty();
+
+				if (ix->t_last < from || ix->t_first > to)
+					continue;
+				for (size_t i = 0; i < pgns.size() && !match; i++)
+					match = zlog.has_pgn(pos, pgns[i]);
+				if (match)
+					break;
+			}
+			if (pos >= zlog.nchunks())
+				return false;
+			if (!zlog.decode(pos, recs))
+				warnx("chunk %zu corrupted, skipped", pos);
+			nread++;
+			pos++;
+			recpos = 0;
+		}
+		*r = recs[recpos++];
+		return true;
+	case CANDUMP:
+		if (have_peek) {
+			*r = peek;
+			have_peek = false;
+			return true;
+		}
+		while (fgets(line, sizeof(line), text) != NULL) {
+			if (parse_candump(line, r, ifname, sizeof(ifname)))
+				return true;
+		}
+		return false;
+	}
+	return false;
+}
+
+bool
+canlog_scan::next(struct canlog_rec *r)
+{
+	while (next_unfiltered(r)) {
+		if (selected(r))
+			return true;
+	}
+	return false;
+}
+
+bool
+canlog_scan::parse_time(const char *s, uint64_t start, uint64_t *t)
+{
+	bool rel = (*s == '+');
+	char *e;
+	double d;
+
+	d = strtod(rel ? s + 1 : s, &e);
+	if (e == s || *e != '\0' || d < 0)
+		return false;
+	*t = (uint64_t)(d * 1e9) + (rel ? start : 0);
+	return true;
+}
+
+static inline int
+hexval(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = tolower((unsigned char)c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+bool
+canlog_scan::parse_candump(const char *line, struct canlog_rec *r,
+    char *ifn, size_t ifnlen)
+{
+	const char *p = line;
+	uint64_t sec, frac = 0;
+	uint32_t id = 0;
+	int ndigits = 0, n, h, l;
+	size_t len;
+
+	if (*p++ != '(' || !isdigit((unsigned char)*p))
+		return false;
+	for (sec = 0; isdigit((unsigned char)*p); p++)
+		sec = sec * 10 + *p - '0';
+	if (*p == '.') {
+		for (p++; isdigit((unsigned char)*p); p++) {
+			if (ndigits++ < 9)
+				frac = frac * 10 + *p - '0';
+		}
+		for (; ndigits < 9; ndigits++)
+			frac *= 10;
+	}
+	if (*p++ != ')')
+		return false;
+	while (*p == ' ')
+		p++;
+	for (len = 0; p[len] != ' ' && p[len] != '\0'; len++)
+		;
+	if (len == 0 || p[len] == '\0')
+		return false;
+	if (ifn != NULL && ifn[0] == '\0') {
+		memcpy(ifn, p, std::min(len, ifnlen - 1));
+		ifn[std::min(len, ifnlen - 1)] = '\0';
+	}
+	p += len;
+	while (*p == ' ')
+		p++;
+	for (n = 0; (h = hexval(*p)) >= 0; p++, n++)
+		id = (id << 4) | h;
+	if (*p++ != '#' || (n != 3 && n != 8))
+		return false;
+
+	memset(r, 0, sizeof(*r));
+	r->ts_ns = sec * 1000000000ULL + frac;
+	if (n == 8) {
+		/* candump keeps the error flag of error frames */
+		if (id & CAN_ERR_FLAG)
+			r->frame.can_id = id & (CAN_ERR_FLAG | CAN_ERR_MASK);
+		else
+			r->frame.can_id = (id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+	} else {
+		r->frame.can_id = id & CAN_SFF_MASK;
+	}
+	if (*p == 'R') {
+		r->frame.can_id |= CAN_RTR_FLAG;
+		r->frame.can_dlc = isdigit((unsigned char)p[1]) ? p[1] - '0' : 0;
+		return true;
+	}
+	for (n = 0; n < CAN_MAX_DLEN; n++) {
+		if (*p == '.')
+			p++;
+		if ((h = hexval(p[0])) < 0 || (l = hexval(p[1])) < 0)
+			break;
+		r->frame.data[n] = (h << 4) | l;
+		p += 2;
+	}
+	r->frame.can_dlc = n;
+	return true;
+}
+
+void
+canlog_scan::print_candump(FILE *fp, const struct canlog_rec *r,
+    const char *ifn)
+{
+	const struct can_frame *cf = &r->frame;
+	int dlc = std::min((int)cf->can_dlc, CAN_MAX_DLEN);
+
+	fprintf(fp, "(%llu.%06llu) %s ",
+	    (unsigned long long)(r->ts_ns / 1000000000ULL),
+	    (unsigned long long)(r->ts_ns % 1000000000ULL) / 1000, ifn);
+	if (cf->can_id & CAN_ERR_FLAG)
+		fprintf(fp, "%08X#", cf->can_id &
+		    (CAN_ERR_FLAG | CAN_ERR_MASK));
+	else if (cf->can_id & CAN_EFF_FLAG)
+		fprintf(fp, "%08X#", cf->can_id & CAN_EFF_MASK);
+	else
+		fprintf(fp, "%03X#", cf->can_id & CAN_SFF_MASK);
+	if (cf->can_id & CAN_RTR_FLAG) {
+		fprintf(fp, "R\n");
+		return;
+	}
+	for (int i = 0; i < dlc; i++)
+		fprintf(fp, "%02X", cf->data[i]);
+	fputc('\n', fp);
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef CANLOGZ_H_
+#define CANLOGZ_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "canlog.h"
+
+/*
+ * chunked CAN log, for long sessions: records are grouped in chunks of
+ * up to CANLOGZ_CHUNK_RECS, each encoded then compressed with zlib on
+ * its own. In a chunk, a record is
+ *	flags	dlc (4 bits), CANLOGZ_SAMEID
+ *	varint	zigzag ts delta (ns) from the previous record
+ *	varint	zigzag can_id delta, unless CANLOGZ_SAMEID
+ *	data	dlc bytes
+ * the first record's deltas are from the chunk's t_start and 0; records
+ * are not necessarily in time order, so t_start may differ from t_first.
+ * The file ends with an index: for each chunk its offset, time range and
+ * the PGNs it contains, so that queries only decompress the chunks they
+ * need. If the index is missing (writer killed) the reader rebuilds
+ * the time index from the chunk headers.
+ * Integers are in the writer's byte order, as for the raw log.
+ */
+#define CANLOGZ_MAGIC	"N2KCHK01"
+#define CANLOGZ_IDX_MAGIC "N2KIDX01"
+#define CANLOGZ_CHUNK_MAGIC 0x4b4e4843	/* "CHNK" */
+#define CANLOGZ_CHUNK_RECS 4096
+#define CANLOGZ_SAMEID	0x10
+#define CANLOGZ_NOPGNS	0xffffffff	/* npgns: unknown, may have any */
+
+struct canlogz_header {
+	char magic[8];
+	uint32_t order;
+	uint32_t chunk_recs;
+	char canif[16];
+	uint64_t start_ns;
+};
+
+struct canlogz_chunk {
+	uint32_t magic;
+	uint32_t nrecs;
+	uint32_t rawlen;	/* encoded size */
+	uint32_t complen;	/* compressed size, following this header */
+	uint64_t t_start;	/* first record time, base of the deltas */
+	uint64_t t_first;	/* min and max record times */
+	uint64_t t_last;
+};
+
+struct canlogz_index {
+	uint64_t offset;	/* of the canlogz_chunk */
+	uint64_t t_first;
+	uint64_t t_last;
+	uint32_t nrecs;
+	uint32_t npgns;
+	uint64_t pgn_first;	/* in the PGN table, which is sorted per chunk */
+};
+
+struct canlogz_trailer {
+	uint64_t index_off;
+	uint32_t nchunks;
+	uint32_t npgns;
+	char magic[8];
+};
+
+class canlogz_writer {
+    public:
+	canlogz_writer();
+	~canlogz_writer();
+
+	bool open(const char *path, const char *canif, uint64_t start_ns);
+	void add(const struct canlog_rec *);
+	bool close();
+
+	inline uint64_t records() const { return nrecs; }
+	inline uint64_t bytes() const { return offset; }
+
+    private:
+	FILE *fp;
+	uint64_t offset;
+	uint64_t nrecs;
+	bool error;
+	/* current chunk */
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> comp;
+	uint32_t chunk_nrecs;
+	uint64_t t_start, t_first, t_last, t_prev;
+	uint32_t id_prev;
+	std::vector<uint32_t> chunk_pgns;
+	/* index */
+	std::vector<struct canlogz_index> index;
+	std::vector<uint32_t> pgns;
+
+	void put(const void *, size_t);
+	void write_chunk();
+};
+
+class canlogz_reader {
+    public:
+	canlogz_reader();
+	~canlogz_reader();
+
+	bool open(const char *path);
+	void close();
+
+	inline const struct canlogz_header *header() const { return hdr; }
+	inline size_t nchunks() const { return nidx; }
+	inline const struct canlogz_index *chunk(size_t i) const
+	    { return &idx[i]; }
+	/* does chunk i have frames of this PGN (true if unknown) */
+	bool has_pgn(size_t i, int pgn) const;
+	/* decode chunk i; false, with nothing decoded, if corrupted */
+	bool decode(size_t i, std::vector<struct canlog_rec> &) const;
+
+    private:
+	void *map;
+	size_t maplen;
+	const struct canlogz_header *hdr;
+	const struct canlogz_index *idx;
+	size_t nidx;
+	const uint32_t *pgns;
+	size_t npgns;
+	std::vector<struct canlogz_index> rebuilt;
+};
+
+/*
+ * sequential reader for all the log formats (raw, chunked, and candump
+ * text), returning the records between two times and for a set of
+ * PGNs. With a chunked log, only the matching chunks are decompressed.
+ */
+class canlog_scan {
+    public:
+	canlog_scan();
+
+	bool open(const char *path);
+	/* "-" reads candump text from stdin */
+	inline const char *canif() const { return ifname; }
+	inline uint64_t start_ns() const { return start; }
+	void set_range(uint64_t from, uint64_t to);
+	void set_pgns(const std::vector<int> &);
+	bool next(struct canlog_rec *);
+	/* chunks decompressed so far */
+	inline size_t chunks_read() const { return nread; }
+
+	/* seconds since the epoch, or +seconds from start */
+	static bool parse_time(const char *, uint64_t start, uint64_t *);
+	/* "(sec.usec) canif id#data" as written by candump -l */
+	static bool parse_candump(const char *, struct canlog_rec *,
+	    char *ifn, size_t ifnlen);
+	static void print_candump(FILE *, const struct canlog_rec *,
+	    const char *ifn);
+
+    private:
+	enum { RAW, CHUNKED, CANDUMP } format;
+	canlog_reader rawlog;
+	canlogz_reader zlog;
+	FILE *text;
+	char ifname[16];
+	uint64_t start;
+	uint64_t from, to;
+	std::vector<int> pgns;
+	size_t pos;	/* raw: record; chunked: chunk */
+	std::vector<struct canlog_rec> recs;
+	size_t recpos;
+	size_t nread;
+	bool have_peek;	/* candump: first record read by open() */
+	struct canlog_rec peek;
+
+	bool selected(const struct canlog_rec *) const;
+	bool next_unfiltered(struct canlog_rec *);
+};
+
+#endif
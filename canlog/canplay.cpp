@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <err.h>
+#include <iostream>
+#include <vector>
+#include "canlog.h"
+#include "canlogz.h"
+#include "nmea2000_tstamp.h"
+
+#define CANPLAY_BATCH	64	/* frames per sendmmsg() */
+#define CANPLAY_SPIN	200000	/* ns; spin instead of sleeping so close */
+
+static bool srcs[256];
+static bool filter_src;
+static uint64_t nskipped;
+
+static void
+usage(void)
+{
+	std::cerr << "usage: " << getprogname() << " [-r rate] [-b from] [-e to] [-p pgn ...] [-s src ...] [-q] <canif> <logfile>" << std::endl;
+	std::cerr << "       rate 1 is real time (default), 0 as fast as possible" << std::endl;
+	std::cerr << "       from and to are seconds since the epoch, or +seconds from the start" << std::endl;
+	exit(1);
+}
+
+static uint64_t
+mono_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * wait until the CLOCK_MONOTONIC time due: sleep on an absolute deadline
+ * (no drift), and spin for the last CANPLAY_SPIN ns, which the scheduler
+ * wakeup latency would otherwise eat.
+ */
+static uint64_t
+wait_until(uint64_t due)
+{
+	struct timespec ts;
+	uint64_t now = mono_now();
+
+	if (due > now + CANPLAY_SPIN) {
+		ts.tv_sec = (due - CANPLAY_SPIN) / 1000000000ULL;
+		ts.tv_nsec = (due - CANPLAY_SPIN) % 1000000000ULL;
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+		    &ts, NULL) == EINTR)
+			;
+		now = mono_now();
+	}
+	while (now < due)
+		now = mono_now();
+	return now;
+}
+
+/* next record to replay: the log selects time and PGNs, we do the rest */
+static bool
+next_frame(canlog_scan &log, struct canlog_rec *r)
+{
+	nmea2000_frame f(&r->frame);
+
+	while (log.next(r)) {
+		if (canlog_reader::is_mark(r) || (filter_src &&
+		    ((r->frame.can_id & CAN_EFF_FLAG) == 0 ||
+		    !srcs[f.getsrc()]))) {
+			nskipped++;
+			continue;
+		}
+		return true;
+	}
+	return false;
+}
+
+/* send all of the batch, waiting for room in the interface queue */
+static bool
+send_batch(int s, struct mmsghdr *msgs, int n)
+{
+	int sent;
+
+	while (n > 0) {
+		sent = sendmmsg(s, msgs, n, 0);
+		if (sent < 0) {
+			if (errno == ENOBUFS || errno == EAGAIN ||
+			    errno == EINTR) {
+				usleep(1000);
+				continue;
+			}
+			warn("sendmmsg");
+			return false;
+		}
+		msgs += sent;
+		n -= sent;
+	}
+	return true;
+}
+
+int
+main(int argc, char * const argv[])
+{
+	struct canlog_rec recs[CANPLAY_BATCH], r;
+	struct iovec iov[CANPLAY_BATCH];
+	struct mmsghdr msgs[CANPLAY_BATCH];
+	canlog_scan log;
+	nmea2000_histogram late;
+	std::vector<int> pgns;
+	const char *from_s = NULL, *to_s = NULL;
+	double rate = 1;
+	bool quiet = false, have;
+	uint64_t t0, base, now, from = 0, to = UINT64_MAX, nsent = 0;
+	int ch, s, nb;
+	char *e;
+	long l;
+
+	while ((ch = getopt(argc, argv, "r:b:e:p:s:q")) != -1) {
+		switch (ch) {
+		case 'r':
+			rate = strtod(optarg, &e);
+			if (*e != '\0' || rate < 0)
+				usage();
+			break;
+		case 'b':
+			from_s = optarg;
+			break;
+		case 'e':
+			to_s = optarg;
+			break;
+		case 'p':
+			pgns.push_back(atoi(optarg));
+			break;
+		case 's':
+			l = strtol(optarg, &e, 0);
+			if (*e != '\0' || l < 0 || l > 255)
+				usage();
+			srcs[l] = true;
+			filter_src = true;
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2)
+		usage();
+
+	if (!log.open(argv[1]))
+		exit(1);
+	if ((from_s != NULL &&
+	    !canlog_scan::parse_time(from_s, log.start_ns(), &from)) ||
+	    (to_s != NULL &&
+	    !canlog_scan::parse_time(to_s, log.start_ns(), &to)))
+		usage();
+	log.set_range(from, to);
+	log.set_pgns(pgns);
+	if (!(have = next_frame(log, &r)))
+		errx(1, "%s: no frame to replay", argv[1]);
+	if ((s = canlog_socket(argv[0])) < 0)
+		exit(1);
+
+	memset(msgs, 0, sizeof(msgs));
+	for (nb = 0; nb < CANPLAY_BATCH; nb++) {
+		msgs[nb].msg_hdr.msg_iov = &iov[nb];
+		msgs[nb].msg_hdr.msg_iovlen = 1;
+		iov[nb].iov_base = &recs[nb].frame;
+		iov[nb].iov_len = sizeof(struct can_frame);
+	}
+	t0 = mono_now();
+	base = r.ts_ns;
+	/*
+	 * a frame is due at t0 plus its offset in the log scaled by rate.
+	 * Wait for the first frame of a batch, then add all the following
+	 * ones which are already due (we're late, or they're simultaneous).
+	 */
+#define DUE(r)	(t0 + (rate > 0 && (r).ts_ns > base ? \
+		    (uint64_t)(((r).ts_ns - base) / rate) : 0))
+	while (have) {
+		now = wait_until(DUE(r));
+		nb = 0;
+		do {
+			late.record(now - DUE(r));
+			recs[nb++] = r;
+			have = next_frame(log, &r);
+		} while (have && nb < CANPLAY_BATCH && DUE(r) <= now);
+		if (!send_batch(s, msgs, nb))
+			exit(1);
+		nsent += nb;
+	}
+#undef DUE
+	if (!quiet) {
+		std::cerr << nsent << " frames sent, " << nskipped
+		    << " skipped, in " << (mono_now() - t0) / 1e9 << "s"
+		    << std::endl;
+		if (rate > 0) {
+			std::cerr << "lateness: ";
+			late.print(std::cerr, false);
+		}
+	}
+	exit(0);
+}
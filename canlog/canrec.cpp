@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <err.h>
+#include <signal.h>
+#include <sys/select.h>
+#include <iostream>
+#include "canlog.h"
+#include "nmea2000_tstamp.h"
+#include "nmea2000_stats.h"
+
+#define CANREC_BATCH	64	/* frames per recvmmsg() */
+
+static volatile sig_atomic_t done;
+
+static void
+usage(void)
+{
+	std::cerr << "usage: " << getprogname() << " [-b rcvbuf_kb] [-q] <canif> <logfile>" << std::endl;
+	exit(1);
+}
+
+static void
+stop_signal(int)
+{
+	done = 1;
+}
+
+int
+main(int argc, char * const argv[])
+{
+	struct can_frame frames[CANREC_BATCH];
+	struct iovec iov[CANREC_BATCH];
+	struct mmsghdr msgs[CANREC_BATCH];
+	char cmsg[CANREC_BATCH][NMEA2000_CMSG_SIZE];
+	struct timespec ts;
+	struct timeval timeout;
+	fd_set read_set;
+	canlog_writer log;
+	uint64_t now, last_flush, nframes = 0, ndrops = 0;
+	uint32_t ovfl, last_ovfl = 0;
+	int rcvbuf = 4096;
+	bool quiet = false, ovfl_on;
+	int ch, s, n;
+
+	while ((ch = getopt(argc, argv, "b:q")) != -1) {
+		switch (ch) {
+		case 'b':
+			rcvbuf = atoi(optarg);
+			break;
+		case 'q':
+			quiet = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 2 || rcvbuf <= 0)
+		usage();
+
+	if ((s = canlog_socket(argv[0])) < 0)
+		exit(1);
+	/* a large socket buffer absorbs the writer's stalls */
+	rcvbuf *= 1024;
+#ifdef SO_RCVBUFFORCE
+	if (setsockopt(s, SOL_SOCKET, SO_RCVBUFFORCE,
+	    &rcvbuf, sizeof(rcvbuf)) < 0)
+#endif
+	if (setsockopt(s, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+		warn("SO_RCVBUF");
+	(void)nmea2000_tstamp_enable(s);
+	ovfl_on = nmea2000_stats::rxq_ovfl_enable(s);
+	if (!log.open(argv[1], argv[0]))
+		exit(1);
+
+	signal(SIGINT, stop_signal);
+	signal(SIGTERM, stop_signal);
+	signal(SIGHUP, stop_signal);
+
+	for (int i = 0; i < CANREC_BATCH; i++) {
+		iov[i].iov_base = &frames[i];
+		iov[i].iov_len = sizeof(frames[i]);
+	}
+	last_flush = canlog_now();
+	while (!done) {
+		/* flush at least once a second, so a crash loses little */
+		now = canlog_now();
+		if (now - last_flush >= 1000000000ULL) {
+			log.flush();
+			last_flush = now;
+		}
+		FD_ZERO(&read_set);
+		FD_SET(s, &read_set);
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+		if (select(s + 1, &read_set, NULL, NULL, &timeout) < 0) {
+			if (errno == EINTR)
+				continue;
+			err(1, "select");
+		}
+		if (!FD_ISSET(s, &read_set))
+			continue;
+		/* drain the socket */
+		do {
+			memset(msgs, 0, sizeof(msgs));
+			for (int i = 0; i < CANREC_BATCH; i++) {
+				msgs[i].msg_hdr.msg_iov = &iov[i];
+				msgs[i].msg_hdr.msg_iovlen = 1;
+				msgs[i].msg_hdr.msg_control = cmsg[i];
+				msgs[i].msg_hdr.msg_controllen =
+				    NMEA2000_CMSG_SIZE;
+			}
+			n = recvmmsg(s, msgs, CANREC_BATCH, MSG_DONTWAIT, NULL);
+			if (n < 0) {
+				if (errno != EAGAIN && errno != EINTR)
+					warn("recvmmsg");
+				break;
+			}
+			now = canlog_now();
+			for (int i = 0; i < n; i++) {
+				if (msgs[i].msg_len < sizeof(struct can_frame))
+					continue;
+				if (ovfl_on && nmea2000_stats::rxq_ovfl_get(
+				    &msgs[i].msg_hdr, &ovfl)) {
+					/* the counter is for the socket's life */
+					if (ovfl != last_ovfl) {
+						log.mark(CANLOG_MARK_DROPS,
+						    ovfl - last_ovfl);
+						ndrops += ovfl - last_ovfl;
+					}
+					last_ovfl = ovfl;
+				}
+				if (nmea2000_tstamp_get(&msgs[i].msg_hdr, &ts))
+					log.add((uint64_t)ts.tv_sec *
+					    1000000000ULL + ts.tv_nsec,
+					    &frames[i]);
+				else
+					log.add(now, &frames[i]);
+				nframes++;
+			}
+		} while (n == CANREC_BATCH && !done);
+	}
+	if (!log.close())
+		exit(1);
+	if (!quiet) {
+		std::cerr << nframes << " frames recorded, " << ndrops
+		    << " dropped by the kernel, " << log.overruns()
+		    << " writer overruns" << std::endl;
+	}
+	exit(0);
+}
@@ -34,6 +34,10 @@
 #include <string.h>
 #include <math.h>
 
+#include "simclock.h"
+#include "yawdyn.h"
+#include "simstream.h"
+
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/sockio.h>
@@ -45,53 +49,6 @@
 #include <linux/can/raw.h>
 #endif
 
-/*
- * based on equations from Pieter Geerkens:
- * https://gamedev.stackexchange.com/questions/92747/2d-boat-controlling-physics
- * with improvements by me.
- */
-const double Mz=5000; /*  The Turning Moment of the ship about the steering axis */
-const double L2=3; /* L/2 The distance of the rudder from the turning axis */
-double v; /*  The current linear velocity of the ship, in m/s */
-double w = 0; /*  The current rotational (yaw) velocity of the ship about the Z-axis */
-const double p0=0; /* The constant, linear and quadratic coefficients */
-const double p1=200; /* respectively of angular friction (ie resistance to */
-const double p2=1000; /* turning) for the water */
-const double A=0.5; /* area of the rudder */
-const double d=1000; /* density of water (in kg/m^3!) */
-
-static void
-update_rot(double sec, double theta)
-{
-	double Tr, Tw, T;
-	double v_r, v_tot;
-	double alpha;
-
-	if (v == 0) {
-		w = 0;
-		return;
-	}
-
-	// printf("sec %f theta %f", sec, theta);
-	/* compute speed vector at rudder */
-	/* radial speed */
-	v_r = v * w;
-	/* resultant speed */
-	v_tot = sqrt(v_r * v_r + v * v);
-	/* speed angle */
-	alpha = atan(v_r / v);
-	//printf("w %f theta %f vr %f alpha %f\n", w, theta, v_r, alpha);
-	/* Turning torque from rudder */
-	Tr = sin(theta - alpha) * A * v_tot * d * L2;
-	/* Friction torque from water */
-	Tw = p1 * fabs(w) + p2 * w * w;
-	if (w > 0)
-		Tw = -Tw;
-	// printf(" w %f Tr %f Tw %f\n", w, Tr, Tw);
-	w = w + (Tr + Tw) / Mz * sec;
-	// printf(" w %f\n", w);
-}
-
 #define PRIVATE_COMMAND_STATUS 61846UL
 struct private_command_status {       
         int16_t heading; /* heading to follow, rad * 10000 */
@@ -115,10 +72,17 @@ struct private_command_status {
 
 int s;
 
+static void
+input_rec(const struct simstream_rec *rec, void *arg)
+{
+	if (rec->valid & (1U << SIMSTREAM_RUDDER))
+		*(double *)arg = rec->v[SIMSTREAM_RUDDER];
+}
+
 static void
 usage()
 {
-	fprintf(stderr, "usage: %s <interface> <speed factor>\n", getprogname());
+	fprintf(stderr, "usage: %s [-c clock] [-I fmt] [-O fmt] <interface> <speed factor>\n", getprogname());
 	exit(1);
 }
 
@@ -131,15 +95,39 @@ main(int argc, const char *argv[])
 	struct can_filter cfi;
 	int r;
 	double rudderb = 0, rudderp = 0;
-	struct timeval tv_p, tv_now;
-	char buf[10];
-
-	if (argc != 3) {
+	struct yawdyn yaw;
+	struct timespec ts_p, ts_now;
+	const char *clockspec = NULL;
+	int stdin_eof = 0;
+	struct simstream in, out;
+	struct simstream_rec rec;
+	int infmt = 0, outfmt = 0;
+	int ch;
+
+	while ((ch = getopt(argc, (char * const *)argv, "c:I:O:")) != -1) {
+		switch (ch) {
+		case 'c':
+			clockspec = optarg;
+			break;
+		case 'I':
+			if ((infmt = simstream_format(optarg)) < 0)
+				usage();
+			break;
+		case 'O':
+			if ((outfmt = simstream_format(optarg)) < 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
+	if (argc != 3 || simclock_init(clockspec) < 0) {
 		usage();
 	}
 
-	v = strtod(argv[2], NULL);
-	v = v * 1852.0 / 3600.0;
+	yawdyn_init(&yaw, strtod(argv[2], NULL));
 
 	if ((s = socket(AF_CAN, SOCK_RAW, CAN_RAW)) < 0) {
 		err(1, "CAN socket");
@@ -160,27 +148,28 @@ main(int argc, const char *argv[])
 	    SOL_CAN_RAW, CAN_RAW_FILTER, &cfi, sizeof(cfi)) < 0) {
                 err(1, "setsockopt(CAN_RAW_FILTER)");
         }
-	if (gettimeofday(&tv_p, NULL) <0) {
-		err(1, "gettimeofday");
-	}
+	simclock_now(&ts_p);
+	simstream_init(&in, 0, infmt, SIMSTREAM_RUDDER);
+	simstream_init(&out, 1, outfmt, SIMSTREAM_ROT);
 
 	while (1) {
-		struct timeval tv_t;
+		struct timespec ts_t;
 		double s_diff;
 		fd_set read_set;
 		int sret;
 
-#if 1
-		tv_t.tv_sec = 0;
-		tv_t.tv_usec = 100000;
-#else
-		tv_t.tv_sec = 2;
-		tv_t.tv_usec = 0;
-#endif
+		/* at most 100ms of simulated time per step */
+		ts_t = ts_p;
+		ts_t.tv_nsec += 100000000;
+		if (ts_t.tv_nsec >= 1000000000) {
+			ts_t.tv_sec++;
+			ts_t.tv_nsec -= 1000000000;
+		}
 		FD_ZERO(&read_set);
 		FD_SET(s, &read_set);
-		FD_SET(0, &read_set);
-		sret = select(s + 1, &read_set, NULL, NULL, &tv_t);
+		if (!stdin_eof)
+			FD_SET(0, &read_set);
+		sret = simclock_select(s + 1, &read_set, NULL, NULL, &ts_t);
 		switch(sret) {
 		case -1:
 			err(1, "select");
@@ -201,25 +190,24 @@ main(int argc, const char *argv[])
 					continue;
 				}
 				rudder = (char)cf.data[4];
-				/* rudder in %, 100%=30deg */
-				rudderb = -rudder * 0.52359878 / 100;
-			}
-			if (FD_ISSET(0, &read_set)) {	
-				if (fgets(buf, sizeof(buf), stdin))
-					rudderp = strtod(buf, NULL);
+				rudderb = yawdyn_rudder(rudder);
 			}
+			if (FD_ISSET(0, &read_set) &&
+			    simstream_read(&in, input_rec, &rudderp) < 0)
+				stdin_eof = 1;
 			break;
 		}
 
-		if (gettimeofday(&tv_now, NULL) <0) {
-			err(1, "gettimeofday");
-		}
-		s_diff = (tv_now.tv_sec - tv_p.tv_sec) +
-		    (tv_now.tv_usec - tv_p.tv_usec) / 1000000.0;
-		update_rot(s_diff, rudderb + rudderp);
-		printf("%f\n", w);
-		fflush(stdout);
-		tv_p = tv_now;
+		simclock_now(&ts_now);
+		s_diff = (ts_now.tv_sec - ts_p.tv_sec) +
+		    (ts_now.tv_nsec - ts_p.tv_nsec) / 1000000000.0;
+		simstream_stamp(&rec);
+		simstream_set(&rec, SIMSTREAM_RUDDER, rudderb + rudderp);
+		simstream_set(&rec, SIMSTREAM_ROT,
+		    yawdyn_step(&yaw, s_diff, rudderb + rudderp));
+		if (simstream_write(&out, &rec) < 0)
+			err(1, "write");
+		ts_p = ts_now;
 	}
 	exit(0);
 }
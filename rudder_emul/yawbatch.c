@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * Monte-Carlo batch runs of the rudder_emul yaw model, for autopilot
+ * gain sweeps: every combination of the -p parameter values is run -m
+ * times (with different random perturbations) for -t seconds, with a
+ * PD heading controller standing in for the autopilot, and the heading
+ * error, rudder and rate of turn are summarised per combination as CSV.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <err.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "yawdyn.h"
+
+#define TICK		0.1	/* s, controller and perturbation update */
+#define SUBSTEPS	10	/* YAWDYN_DT steps per tick */
+#define RUDDER_MAX	0.52359878 /* 30deg */
+#define BLOCK		256	/* vessels stepped together */
+
+enum {
+	P_SPEED, P_MZ, P_L2, P_P1, P_P2, P_A,
+	P_KP, P_KD,
+	P_WAVE, P_PERIOD, P_NOISE, P_NOISET,
+	P_NPARAMS
+};
+
+static struct param {
+	const char *name;
+	const char *descr;
+	double def;
+	double *vals;
+	int nvals;
+} params[P_NPARAMS] = {
+	{ "speed",	"boat speed, knots",			6, NULL, 0 },
+	{ "Mz",		"turning moment",			0, NULL, 0 },
+	{ "L2",		"rudder distance to the turning axis",	0, NULL, 0 },
+	{ "p1",		"linear friction",			0, NULL, 0 },
+	{ "p2",		"quadratic friction",			0, NULL, 0 },
+	{ "A",		"rudder area",				0, NULL, 0 },
+	{ "kp",		"rudder per rad of heading error",	1, NULL, 0 },
+	{ "kd",		"rudder per rad/s of rate of turn",	1, NULL, 0 },
+	{ "wave",	"sinus perturbation, rad",		0.05, NULL, 0 },
+	{ "period",	"sinus perturbation period, s",		8, NULL, 0 },
+	{ "noise",	"random perturbation, rad",		0.02, NULL, 0 },
+	{ "noiset",	"random perturbation mean hold time, s", 5, NULL, 0 },
+};
+
+/*
+ * the vessels, structure of arrays. With the rudder angle held during a
+ * step, the model of yawdyn.c reduces to
+ * dw/dt = kv * (sin(theta) - w * cos(theta)) - c1 * w - c2 * w * |w|
+ * (the atan() and sqrt() of the rudder speed vector cancel out), which
+ * the RK4 loop evaluates without any libm call or branch.
+ */
+struct fleet {
+	size_t n;
+	/* constants */
+	double *kv;	/* A * d * L2 * |v| / Mz */
+	double *c1;	/* p1 / Mz */
+	double *c2;	/* p2 / Mz */
+	double *kp, *kd;
+	double *wave;
+	double *rc, *rs; /* wave oscillator rotation per tick */
+	double *noise, *noiset;
+	/* state */
+	double *w;	/* rate of turn */
+	double *hdg;	/* heading error */
+	double *ox, *oy; /* wave oscillator */
+	double *nval, *ntime; /* random perturbation and its time left */
+	uint64_t *rng;
+	double *st, *ct; /* sin and cos of the rudder angle for this tick */
+	/* metrics */
+	double *e2, *emax, *r2, *wmax;
+};
+
+struct job {
+	struct fleet *f;
+	size_t from, to;
+	long nticks;
+	pthread_t thr;
+};
+
+static void
+usage(void)
+{
+	int i;
+
+	fprintf(stderr, "usage: %s [-j threads] [-t seconds] [-m runs] "
+	    "[-S seed] [-p name=values ...]\n", getprogname());
+	fprintf(stderr, "values are v, v1,v2,... or min:max:count; names:\n");
+	for (i = 0; i < P_NPARAMS; i++) {
+		fprintf(stderr, "  %-7s %s (%g)\n", params[i].name,
+		    params[i].descr, params[i].def);
+	}
+	exit(1);
+}
+
+static double *
+darray(size_t n)
+{
+	void *p;
+
+	if (posix_memalign(&p, 64, n * sizeof(double)) != 0)
+		err(1, "malloc");
+	memset(p, 0, n * sizeof(double));
+	return p;
+}
+
+static uint64_t
+splitmix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+/* xorshift64*, uniform in [0, 1) */
+static double
+urand(uint64_t *s)
+{
+	uint64_t x = *s;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*s = x;
+	return ((x * 0x2545f4914f6cdd1dULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* parse "name=v", "name=v1,v2,..." or "name=min:max:count" */
+static int
+param_parse(const char *arg)
+{
+	struct param *p;
+	const char *eq = strchr(arg, '=');
+	double lo, hi;
+	char *e;
+	int i, n;
+
+	if (eq == NULL)
+		return -1;
+	for (p = params; p < &params[P_NPARAMS]; p++) {
+		if (strlen(p->name) == (size_t)(eq - arg) &&
+		    strncmp(p->name, arg, eq - arg) == 0)
+			break;
+	}
+	if (p == &params[P_NPARAMS])
+		return -1;
+	free(p->vals);
+	p->vals = NULL;
+	p->nvals = 0;
+	if (sscanf(eq + 1, "%lf:%lf:%d", &lo, &hi, &n) == 3) {
+		if (n < 1)
+			return -1;
+		if ((p->vals = malloc(n * sizeof(double))) == NULL)
+			err(1, "malloc");
+		for (i = 0; i < n; i++)
+			p->vals[i] = (n == 1) ? lo : lo + (hi - lo) * i / (n - 1);
+		p->nvals = n;
+		return 0;
+	}
+	for (arg = eq + 1;; arg = e + 1) {
+		if ((p->vals = realloc(p->vals,
+		    (p->nvals + 1) * sizeof(double))) == NULL)
+			err(1, "malloc");
+		p->vals[p->nvals] = strtod(arg, &e);
+		if (e == arg || (*e != ',' && *e != '\0'))
+			return -1;
+		p->nvals++;
+		if (*e == '\0')
+			return 0;
+	}
+}
+
+/* the parameters of combination c; the first parameter varies fastest */
+static void
+config_get(size_t c, double *v)
+{
+	int i;
+
+	for (i = 0; i < P_NPARAMS; i++) {
+		v[i] = params[i].vals[c % params[i].nvals];
+		c /= params[i].nvals;
+	}
+}
+
+static void
+fleet_init(struct fleet *f, size_t ncfg, int runs, uint64_t seed)
+{
+	const struct yawdyn_params *Y = &yawdyn_defaults;
+	double v[P_NPARAMS], speed, k;
+	size_t i, n = ncfg * runs;
+
+	f->n = n;
+	f->kv = darray(n); f->c1 = darray(n); f->c2 = darray(n);
+	f->kp = darray(n); f->kd = darray(n);
+	f->wave = darray(n); f->rc = darray(n); f->rs = darray(n);
+	f->noise = darray(n); f->noiset = darray(n);
+	f->w = darray(n); f->hdg = darray(n);
+	f->ox = darray(n); f->oy = darray(n);
+	f->nval = darray(n); f->ntime = darray(n);
+	f->st = darray(n); f->ct = darray(n);
+	f->e2 = darray(n); f->emax = darray(n);
+	f->r2 = darray(n); f->wmax = darray(n);
+	if ((f->rng = calloc(n, sizeof(uint64_t))) == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < n; i++) {
+		config_get(i / runs, v);
+		speed = fabs(v[P_SPEED]) * 1852.0 / 3600.0;
+		f->kv[i] = v[P_A] * Y->d * v[P_L2] * speed / v[P_MZ];
+		f->c1[i] = v[P_P1] / v[P_MZ];
+		f->c2[i] = v[P_P2] / v[P_MZ];
+		f->kp[i] = v[P_KP];
+		f->kd[i] = v[P_KD];
+		f->wave[i] = v[P_WAVE];
+		k = 6.2831853071795865 * TICK / v[P_PERIOD];
+		f->rc[i] = cos(k);
+		f->rs[i] = sin(k);
+		f->noise[i] = v[P_NOISE];
+		f->noiset[i] = v[P_NOISET];
+		/* every vessel has its own random sequence and wave phase */
+		f->rng[i] = splitmix(seed + i) | 1;
+		k = 6.2831853071795865 * urand(&f->rng[i]);
+		f->ox[i] = cos(k);
+		f->oy[i] = sin(k);
+	}
+}
+
+/* controller, perturbation and metrics, once per tick */
+static void
+fleet_tick(struct fleet *f, size_t from, size_t to)
+{
+	double rudder, theta, x;
+	size_t i;
+
+	for (i = from; i < to; i++) {
+		rudder = -(f->kp[i] * f->hdg[i] + f->kd[i] * f->w[i]);
+		if (rudder > RUDDER_MAX)
+			rudder = RUDDER_MAX;
+		if (rudder < -RUDDER_MAX)
+			rudder = -RUDDER_MAX;
+
+		x = f->ox[i] * f->rc[i] - f->oy[i] * f->rs[i];
+		f->oy[i] = f->ox[i] * f->rs[i] + f->oy[i] * f->rc[i];
+		f->ox[i] = x;
+		f->ntime[i] -= TICK;
+		if (f->ntime[i] <= 0) {
+			/* as sea_emul -r */
+			f->ntime[i] += f->noiset[i] * (urand(&f->rng[i]) + 0.5);
+			f->nval[i] = f->noise[i] * (urand(&f->rng[i]) * 2 - 1);
+		}
+		theta = rudder + f->wave[i] * f->oy[i] + f->nval[i];
+		f->st[i] = sin(theta);
+		f->ct[i] = cos(theta);
+
+		f->e2[i] += f->hdg[i] * f->hdg[i];
+		f->emax[i] = fmax(f->emax[i], fabs(f->hdg[i]));
+		f->r2[i] += rudder * rudder;
+		f->wmax[i] = fmax(f->wmax[i], fabs(f->w[i]));
+	}
+}
+
+#define ACCEL(w) (kv[i] * (st[i] - (w) * ct[i]) - c1[i] * (w) - \
+	c2[i] * (w) * fabs(w))
+
+/* one RK4 step of the yaw dynamics, and heading integration, for n lanes */
+static void
+rk4(size_t n, const double * restrict kv, const double * restrict c1,
+    const double * restrict c2, const double * restrict st,
+    const double * restrict ct, double * restrict w, double * restrict hdg)
+{
+	const double h = YAWDYN_DT;
+	double k1, k2, k3, k4, wn;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		k1 = ACCEL(w[i]);
+		k2 = ACCEL(w[i] + h / 2 * k1);
+		k3 = ACCEL(w[i] + h / 2 * k2);
+		k4 = ACCEL(w[i] + h * k3);
+		wn = w[i] + h / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+		hdg[i] += h / 2 * (w[i] + wn);
+		w[i] = wn;
+	}
+}
+
+static void
+fleet_step(struct fleet *f, size_t from, size_t to)
+{
+	int s;
+
+	for (s = 0; s < SUBSTEPS; s++) {
+		rk4(to - from, &f->kv[from], &f->c1[from], &f->c2[from],
+		    &f->st[from], &f->ct[from], &f->w[from], &f->hdg[from]);
+	}
+}
+
+static void *
+job_run(void *arg)
+{
+	struct job *j = arg;
+	size_t b, e;
+	long t;
+
+	for (b = j->from; b < j->to; b = e) {
+		e = b + BLOCK < j->to ? b + BLOCK : j->to;
+		for (t = 0; t < j->nticks; t++) {
+			fleet_tick(j->f, b, e);
+			fleet_step(j->f, b, e);
+		}
+	}
+	return NULL;
+}
+
+int
+main(int argc, char * const argv[])
+{
+	struct fleet f;
+	struct job *jobs;
+	struct timespec t0, t1;
+	double duration = 600, v[P_NPARAMS], elapsed;
+	double e2, emax, r2, wmax;
+	uint64_t seed = 1;
+	size_t ncfg, c, i;
+	long nticks;
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	int runs = 1;
+	int ch, r;
+
+	params[P_MZ].def = yawdyn_defaults.Mz;
+	params[P_L2].def = yawdyn_defaults.L2;
+	params[P_P1].def = yawdyn_defaults.p1;
+	params[P_P2].def = yawdyn_defaults.p2;
+	params[P_A].def = yawdyn_defaults.A;
+
+	while ((ch = getopt(argc, argv, "j:t:m:S:p:")) != -1) {
+		switch (ch) {
+		case 'j':
+			nthreads = atoi(optarg);
+			break;
+		case 't':
+			duration = strtod(optarg, NULL);
+			break;
+		case 'm':
+			runs = atoi(optarg);
+			break;
+		case 'S':
+			seed = strtoull(optarg, NULL, 0);
+			break;
+		case 'p':
+			if (param_parse(optarg) < 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || duration <= 0 || runs < 1)
+		usage();
+	if (nthreads < 1)
+		nthreads = 1;
+
+	ncfg = 1;
+	for (i = 0; i < P_NPARAMS; i++) {
+		if (params[i].nvals == 0) {
+			params[i].vals = &params[i].def;
+			params[i].nvals = 1;
+		}
+		ncfg *= params[i].nvals;
+	}
+	nticks = (long)(duration / TICK + 0.5);
+	fleet_init(&f, ncfg, runs, seed);
+
+	if ((jobs = calloc(nthreads, sizeof(*jobs))) == NULL)
+		err(1, "malloc");
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < (size_t)nthreads; i++) {
+		jobs[i].f = &f;
+		jobs[i].from = f.n * i / nthreads;
+		jobs[i].to = f.n * (i + 1) / nthreads;
+		jobs[i].nticks = nticks;
+		if (pthread_create(&jobs[i].thr, NULL, job_run, &jobs[i]) != 0)
+			err(1, "pthread_create");
+	}
+	for (i = 0; i < (size_t)nthreads; i++)
+		pthread_join(jobs[i].thr, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	elapsed = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+	/* per combination: rms averaged over the runs, max over the runs */
+	for (i = 0; i < P_NPARAMS; i++)
+		printf("%s,", params[i].name);
+	printf("herr_rms,herr_max,rudder_rms,rot_max\n");
+	for (c = 0; c < ncfg; c++) {
+		e2 = emax = r2 = wmax = 0;
+		for (r = 0; r < runs; r++) {
+			i = c * runs + r;
+			e2 += sqrt(f.e2[i] / nticks);
+			emax = fmax(emax, f.emax[i]);
+			r2 += sqrt(f.r2[i] / nticks);
+			wmax = fmax(wmax, f.wmax[i]);
+		}
+		config_get(c, v);
+		for (i = 0; i < P_NPARAMS; i++)
+			printf("%g,", v[i]);
+		printf("%g,%g,%g,%g\n", e2 / runs, emax, r2 / runs, wmax);
+	}
+	fprintf(stderr, "%zu vessels, %.0f vessel-seconds in %.2fs: "
+	    "%.3g vessel-seconds/s\n", f.n, (double)f.n * nticks * TICK,
+	    elapsed, f.n * nticks * TICK / elapsed);
+	exit(0);
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <math.h>
+
+#include "yawdyn.h"
+
+/*
+ * based on equations from Pieter Geerkens:
+ * https://gamedev.stackexchange.com/questions/92747/2d-boat-controlling-physics
+ * with improvements by me.
+ */
+const struct yawdyn_params yawdyn_defaults = {
+	5000,	/* Mz */
+	3,	/* L2 */
+	0,	/* p0 */
+	200,	/* p1 */
+	1000,	/* p2 */
+	0.5,	/* A */
+	1000,	/* d */
+};
+
+/* speed in knots */
+void
+yawdyn_init(struct yawdyn *y, double speed)
+{
+	y->v = speed * 1852.0 / 3600.0;
+	y->w = 0;
+	y->t = 0;
+}
+
+/* yaw acceleration at rate of turn w, with the rudder at theta */
+static double
+yawdyn_accel(double v, double w, double theta)
+{
+	const struct yawdyn_params *P = &yawdyn_defaults;
+	double Tr, Tw;
+	double v_r, v_tot;
+	double alpha;
+
+	/* compute speed vector at rudder */
+	/* radial speed */
+	v_r = v * w;
+	/* resultant speed */
+	v_tot = sqrt(v_r * v_r + v * v);
+	/* speed angle */
+	alpha = atan(v_r / v);
+	/* Turning torque from rudder */
+	Tr = sin(theta - alpha) * P->A * v_tot * P->d * P->L2;
+	/* Friction torque from water */
+	Tw = P->p1 * fabs(w) + P->p2 * w * w;
+	if (w > 0)
+		Tw = -Tw;
+	return (Tr + Tw) / P->Mz;
+}
+
+/* advance sec seconds with the rudder at theta (rad), return the rot */
+double
+yawdyn_step(struct yawdyn *y, double sec, double theta)
+{
+	const double h = YAWDYN_DT;
+	double v = y->v;
+	double w = y->w;
+	double k1, k2, k3, k4;
+
+	if (v == 0) {
+		y->w = y->t = 0;
+		return 0;
+	}
+
+	if (sec > 0)
+		y->t += sec;
+	/* the last 1ns is rounding */
+	while (y->t >= h - 1e-9) {
+		k1 = yawdyn_accel(v, w, theta);
+		k2 = yawdyn_accel(v, w + h / 2 * k1, theta);
+		k3 = yawdyn_accel(v, w + h / 2 * k2, theta);
+		k4 = yawdyn_accel(v, w + h * k3, theta);
+		w = w + h / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+		y->t -= h;
+	}
+	y->w = w;
+	return w;
+}
+
+/* rudder angle (rad) from the autopilot's report, in %, 100%=30deg */
+double
+yawdyn_rudder(int rudder)
+{
+	return -rudder * 0.52359878 / 100;
+}
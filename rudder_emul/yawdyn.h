@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef YAWDYN_H_
+#define YAWDYN_H_
+
+/*
+ * yaw dynamics of a boat under the action of its rudder: the rate of
+ * turn from the rudder angle and the boat speed.
+ * The model is integrated with RK4 at a fixed YAWDYN_DT, whatever the
+ * time steps asked for: a step shorter than YAWDYN_DT is carried over
+ * to the next one, a longer one (a late wakeup) is done in as many
+ * sub-steps as needed. The rudder angle is held during a step.
+ */
+#define YAWDYN_DT	0.01	/* s */
+
+/* the boat and water constants */
+struct yawdyn_params {
+	double Mz; /* The Turning Moment of the ship about the steering axis */
+	double L2; /* L/2 The distance of the rudder from the turning axis */
+	double p0; /* The constant, linear and quadratic coefficients */
+	double p1; /* respectively of angular friction (ie resistance to */
+	double p2; /* turning) for the water */
+	double A; /* area of the rudder */
+	double d; /* density of water (in kg/m^3!) */
+};
+extern const struct yawdyn_params yawdyn_defaults;
+
+struct yawdyn {
+	double v; /* The current linear velocity of the ship, in m/s */
+	double w; /* The current rotational (yaw) velocity of the ship */
+	double t; /* time not integrated yet, s */
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void yawdyn_init(struct yawdyn *, double);
+double yawdyn_step(struct yawdyn *, double, double);
+double yawdyn_rudder(int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/*
+ * tests for yawdyn: the RK4 integration is compared with a fine-step
+ * reference of the same equations, for several speeds and rudder
+ * angles; the result must not depend on how the time is cut in steps.
+ * Then the integration speed is measured, in steps per second.
+ * Exits with status 1 if a test fails.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <err.h>
+#include <math.h>
+#include <time.h>
+
+#include "yawdyn.h"
+
+#define REF_DT	1e-5	/* s */
+#define MAXERR	1e-8	/* rad/s */
+
+static int nfail;
+
+/* the yaw acceleration, written again from the model's equations */
+static double
+ref_accel(double v, double w, double theta)
+{
+	const struct yawdyn_params *P = &yawdyn_defaults;
+	double v_r = v * w;
+	double Tr, Tw;
+
+	Tr = sin(theta - atan(v_r / v)) * P->A * sqrt(v_r * v_r + v * v) *
+	    P->d * P->L2;
+	Tw = P->p1 * fabs(w) + P->p2 * w * w;
+	return (Tr - copysign(Tw, w)) / P->Mz;
+}
+
+/* RK4 with a small step, from w for sec seconds */
+static double
+ref_step(double v, double w, double sec, double theta)
+{
+	const double h = REF_DT;
+	double k1, k2, k3, k4;
+	long n;
+
+	for (n = lround(sec / h); n > 0; n--) {
+		k1 = ref_accel(v, w, theta);
+		k2 = ref_accel(v, w + h / 2 * k1, theta);
+		k3 = ref_accel(v, w + h / 2 * k2, theta);
+		k4 = ref_accel(v, w + h * k3, theta);
+		w += h / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+	}
+	return w;
+}
+
+/* 20s in 100ms steps, the rudder changing every 2s */
+static void
+check_convergence(double speed)
+{
+	struct yawdyn y;
+	double v = speed * 1852.0 / 3600.0;
+	double wr = 0, w, theta, err, maxerr = 0;
+	int i;
+
+	yawdyn_init(&y, speed);
+	for (i = 0; i < 200; i++) {
+		theta = 0.4 * sin(i / 20 * 2.0);
+		w = yawdyn_step(&y, 0.1, theta);
+		wr = ref_step(v, wr, 0.1, theta);
+		err = fabs(w - wr);
+		if (err > maxerr)
+			maxerr = err;
+	}
+	printf("speed %4.1fkn: max error %.2e rad/s\n", speed, maxerr);
+	if (!(maxerr < MAXERR)) {
+		warnx("speed %.1fkn: error %g > %g", speed, maxerr, MAXERR);
+		nfail++;
+	}
+}
+
+/* the same 10s in one step, in 100ms steps and in random steps */
+static void
+check_steps(void)
+{
+	struct yawdyn y1, y2, y3;
+	double t, s;
+
+	yawdyn_init(&y1, 6);
+	yawdyn_step(&y1, 10, 0.3);
+
+	yawdyn_init(&y2, 6);
+	for (t = 0; t < 10 - 1e-9; t += 0.1)
+		yawdyn_step(&y2, 0.1, 0.3);
+
+	yawdyn_init(&y3, 6);
+	srandom(1);
+	for (t = 0; t < 10 - 1e-9; t += s) {
+		s = (random() % 2000) / 10000.0;
+		if (t + s > 10)
+			s = 10 - t;
+		yawdyn_step(&y3, s, 0.3);
+	}
+	if (fabs(y1.w - y2.w) > 1e-12 || fabs(y1.w - y3.w) > 1e-12) {
+		warnx("steps: 10s %.12f, 100ms %.12f, random %.12f",
+		    y1.w, y2.w, y3.w);
+		nfail++;
+	}
+
+	yawdyn_init(&y1, 0);
+	if (yawdyn_step(&y1, 1, 0.3) != 0) {
+		warnx("steps: rot %g at speed 0", y1.w);
+		nfail++;
+	}
+}
+
+static void
+bench(void)
+{
+	struct timespec start, now;
+	struct yawdyn y;
+	double el;
+	long n = 0;
+	int i = 0;
+
+	yawdyn_init(&y, 6);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	do {
+		/* 10000 steps, with the rudder going back and forth */
+		yawdyn_step(&y, 10000 * YAWDYN_DT, (i++ & 1) ? 0.3 : -0.3);
+		n += 10000;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		el = (now.tv_sec - start.tv_sec) +
+		    (now.tv_nsec - start.tv_nsec) / 1e9;
+	} while (el < 1);
+	printf("%.3g steps/s, %.3g times real time\n", n / el,
+	    n * YAWDYN_DT / el);
+}
+
+int
+main(void)
+{
+	check_convergence(2);
+	check_convergence(6);
+	check_convergence(12);
+	check_steps();
+	bench();
+	if (nfail != 0)
+		errx(1, "%d tests failed", nfail);
+	exit(0);
+}
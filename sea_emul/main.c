@@ -36,143 +36,109 @@
 
 #include <sys/time.h>
 
+#include "simclock.h"
+#include "perturb.h"
+#include "simstream.h"
+
 static void
 usage()
 {
-	fprintf(stderr, "usage: %s [-s a:p] [-q a:t1:t0] [-r a:t]\n", getprogname());
+	fprintf(stderr, "usage: %s [-c clock] [-I fmt] [-O fmt] [-S seed] [-s a:p] [-q a:t1:t0] [-r a:t]\n"
+	    "       [-w Hs:Tp[:dir[:gamma]]]\n", getprogname());
 	exit(1);
 }
 
-struct perturb_descript
-{
-	enum type {
-		t_sinus,
-		t_square,
-		t_random
-	} type;
-	double a;
-	double p0, p1;
-	double time;
-	double val;
-};
-
 static void
-doubletotimer(double v, struct timeval *tv)
+input_rec(const struct simstream_rec *rec, void *arg)
 {
-	tv->tv_sec = v;
-	v = v - tv->tv_sec;
-	tv->tv_usec = v * 1000000;
+	if (rec->valid & (1U << SIMSTREAM_RUDDER))
+		*(double *)arg = rec->v[SIMSTREAM_RUDDER];
 }
 
 static double
-timetodouble(struct timeval *tv)
+timetodouble(struct timespec *ts)
 {
 	double v;
-	v = tv->tv_sec;
-	v += tv->tv_usec / 1000000.0;
-	return v;
-}
-
-static double
-strsepandd(char **str, const char *sep)
-{
-	char *a;
-	char *e;
-	double d;
-	a = strsep(str, sep);
-	if (a == NULL) {
-		usage();
-	}
-	d = strtod(a, &e);
-	if (*e != '\0') {
-		usage();
-	}
-	return d;
-}
-
-static double
-drandom() {
-	double v;
-	v = random();
-	v /= RANDOM_MAX;
+	v = ts->tv_sec;
+	v += ts->tv_nsec / 1000000000.0;
 	return v;
 }
 
-
 int
 main(int argc, char * const argv[])
 {
-	struct timeval tv_p, tv_now;
-	char buf[10];
-	struct perturb_descript *pd;
-	int c, i;
-	int npd;
-	char *a;
+	struct timespec ts_p, ts_now;
+	const char *clockspec = NULL;
+	int stdin_eof = 0;
+	struct simstream in, out;
+	struct simstream_rec rec;
+	int infmt = 0, outfmt = 0;
+	unsigned long seed = time(NULL);
+	struct perturb pert;
+	int c;
 	double input_pert;
 	double total_pert, new_pert;
-	double last_print;
 
 	if (argc < 2) {
 		usage();
 	}
 
-	npd = (argc - 1); /* overkill, but whatever */
-	pd = malloc(sizeof(*pd) * npd);
-	if (pd == NULL) {
-		err(1, "malloc");
-	}
-	memset(pd, 0, sizeof(*pd) * npd);
-
-	i = 0;
-	while ((c = getopt(argc, argv, "s:r:q:")) > 0) {
+	perturb_init(&pert);
+	while ((c = getopt(argc, argv, "c:I:O:S:s:r:q:w:")) > 0) {
 		switch(c) {
-		case 's':
-			pd[i].type = t_sinus;
-			pd[i].a = strsepandd(&optarg, ":");
-			pd[i].p0 = strsepandd(&optarg, ":");
+		case 'c':
+			clockspec = optarg;
 			break;
-		case 'q':
-			pd[i].type = t_square;
-			pd[i].a = strsepandd(&optarg, ":");
-			pd[i].p0 = strsepandd(&optarg, ":");
-			pd[i].p1 = strsepandd(&optarg, ":");
+		case 'I':
+			if ((infmt = simstream_format(optarg)) < 0)
+				usage();
+			break;
+		case 'O':
+			if ((outfmt = simstream_format(optarg)) < 0)
+				usage();
+			break;
+		case 'S':
+			seed = strtoul(optarg, NULL, 0);
 			break;
+		case 's':
+		case 'q':
 		case 'r':
-			pd[i].type = t_random;
-			pd[i].a = strsepandd(&optarg, ":");
-			pd[i].p0 = strsepandd(&optarg, ":");
+		case 'w':
+			if (perturb_add(&pert, c, optarg) < 0)
+				usage();
 			break;
 		default:
 			usage();
 		}
-		i++;
 	}
-	npd = i;
 
-	if (gettimeofday(&tv_p, NULL) <0) {
-		err(1, "gettimeofday");
+	if (simclock_init(clockspec) < 0) {
+		usage();
 	}
+	simclock_now(&ts_p);
+	simstream_init(&in, 0, infmt, SIMSTREAM_RUDDER);
+	simstream_init(&out, 1, outfmt, SIMSTREAM_RUDDER);
 
-	srandom(time(NULL));
-	last_print = 0;
+	srandom(seed);
+	input_pert = total_pert = 0;
 
 	while (1) {
-		struct timeval tv_t, tv_diff;
+		struct timespec ts_t, ts_diff;
 		double timediff;
-		double v;
 		fd_set read_set;
 		int sret;
 
-#if 1
-		tv_t.tv_sec = 0;
-		tv_t.tv_usec = 100000;
-#else
-		tv_t.tv_sec = 2;
-		tv_t.tv_usec = 0;
-#endif
+		/* at most 100ms of simulated time per step */
+		ts_t = ts_p;
+		ts_t.tv_nsec += 100000000;
+		if (ts_t.tv_nsec >= 1000000000) {
+			ts_t.tv_sec++;
+			ts_t.tv_nsec -= 1000000000;
+		}
 		FD_ZERO(&read_set);
-		FD_SET(0, &read_set);
-		sret = select(1, &read_set, NULL, NULL, &tv_t);
+		if (!stdin_eof)
+			FD_SET(0, &read_set);
+		sret = simclock_select(1, &read_set, NULL, NULL, &ts_t);
 		switch(sret) {
 		case -1:
 			err(1, "select");
@@ -180,59 +146,31 @@ main(int argc, char * const argv[])
 		case 0:
 			break;
 		default:
-			if (FD_ISSET(0, &read_set)) {	
-				if (fgets(buf, sizeof(buf), stdin))
-					input_pert = strtod(buf, NULL);
-			}
+			if (FD_ISSET(0, &read_set) &&
+			    simstream_read(&in, input_rec, &input_pert) < 0)
+				stdin_eof = 1;
 			break;
 		}
-		new_pert = input_pert;
 
-		if (gettimeofday(&tv_now, NULL) <0) {
-			err(1, "gettimeofday");
+		simclock_now(&ts_now);
+		ts_diff.tv_sec = ts_now.tv_sec - ts_p.tv_sec;
+		ts_diff.tv_nsec = ts_now.tv_nsec - ts_p.tv_nsec;
+		if (ts_diff.tv_nsec < 0) {
+			ts_diff.tv_sec--;
+			ts_diff.tv_nsec += 1000000000;
 		}
-		timersub(&tv_now, &tv_p, &tv_diff);
-		timediff = timetodouble(&tv_diff);
-
-		for (i = 0; i < npd; i++) {
-			pd[i].time += timediff;
-			switch(pd[i].type) {
-			case t_sinus:
-				if (pd[i].time > pd[i].p0)
-					pd[i].time -= pd[i].p0;
-				v = pd[i].time / pd[i].p0 * 6.2831854;
-				pd[i].val = sin(v) * pd[i].a;
-				break;
-			case t_square:
-				if (pd[i].val == pd[i].a) {
-					if (pd[i].time > pd[i].p0) {
-						pd[i].time -= pd[i].p0;
-						pd[i].val = 0;
-					}
-				} else {
-					if (pd[i].time > pd[i].p1) {
-						pd[i].time -= pd[i].p1;
-						pd[i].val = pd[i].a;
-					}
-				}
-				break;
-			case t_random:
-				if (pd[i].time > pd[i].p1) {
-					pd[i].time -= pd[i].p1;
-					pd[i].p1 = pd[i].p0 * (drandom() + 0.5);
-					pd[i].val = pd[i].a * (drandom() * 2 - 1);
-				}
-				break;
-			}
-			new_pert += pd[i].val;
-		}
-		if (fabs(total_pert - new_pert) > 0.001) {
-			total_pert = new_pert;
+		timediff = timetodouble(&ts_diff);
+
+		new_pert = input_pert + perturb_step(&pert, timediff);
+		/* binary streams get every step */
+		if (outfmt || fabs(total_pert - new_pert) > 0.001) {
 			total_pert = new_pert;
-			printf("%f\n", new_pert);
-			fflush(stdout);
+			simstream_stamp(&rec);
+			simstream_set(&rec, SIMSTREAM_RUDDER, new_pert);
+			if (simstream_write(&out, &rec) < 0)
+				err(1, "write");
 		}
-		tv_p = tv_now;
+		ts_p = ts_now;
 	}
 	exit(0);
 }
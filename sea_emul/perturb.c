@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "perturb.h"
+
+void
+perturb_init(struct perturb *p)
+{
+	p->pd = NULL;
+	p->npd = 0;
+}
+
+void
+perturb_free(struct perturb *p)
+{
+	int i;
+
+	for (i = 0; i < p->npd; i++) {
+		if (p->pd[i].spec != NULL) {
+			free(p->pd[i].spec->re);
+			free(p->pd[i].spec);
+		}
+	}
+	free(p->pd);
+	perturb_init(p);
+}
+
+static int
+strsepandd(char **str, const char *sep, double *d)
+{
+	char *a;
+	char *e;
+	a = strsep(str, sep);
+	if (a == NULL) {
+		return -1;
+	}
+	*d = strtod(a, &e);
+	if (e == a || *e != '\0') {
+		return -1;
+	}
+	return 0;
+}
+
+static double
+drandom() {
+	double v;
+	v = random();
+	v /= RANDOM_MAX;
+	return v;
+}
+
+/* add a wave, from the sea_emul option letter and its argument */
+int
+perturb_add(struct perturb *p, int c, const char *arg)
+{
+	struct perturb_descript pd, *npd;
+	char *s, *str;
+	int r = 0;
+
+	memset(&pd, 0, sizeof(pd));
+	if ((str = s = strdup(arg)) == NULL)
+		return -1;
+	switch(c) {
+	case 's':
+		pd.type = t_sinus;
+		if (strsepandd(&s, ":", &pd.a) < 0 ||
+		    strsepandd(&s, ":", &pd.p0) < 0)
+			r = -1;
+		break;
+	case 'q':
+		pd.type = t_square;
+		if (strsepandd(&s, ":", &pd.a) < 0 ||
+		    strsepandd(&s, ":", &pd.p0) < 0 ||
+		    strsepandd(&s, ":", &pd.p1) < 0)
+			r = -1;
+		break;
+	case 'r':
+		pd.type = t_random;
+		if (strsepandd(&s, ":", &pd.a) < 0 ||
+		    strsepandd(&s, ":", &pd.p0) < 0)
+			r = -1;
+		break;
+	case 'w':
+		pd.type = t_spectrum;
+		pd.spec = calloc(1, sizeof(*pd.spec));
+		if (pd.spec == NULL) {
+			r = -1;
+			break;
+		}
+		pd.spec->dir = 45;
+		pd.spec->gamma = 3.3;
+		if (strsepandd(&s, ":", &pd.spec->hs) < 0 ||
+		    strsepandd(&s, ":", &pd.spec->tp) < 0 ||
+		    (s != NULL && strsepandd(&s, ":", &pd.spec->dir) < 0) ||
+		    (s != NULL && strsepandd(&s, ":", &pd.spec->gamma) < 0) ||
+		    s != NULL || pd.spec->hs < 0 || pd.spec->tp <= 0 ||
+		    pd.spec->gamma < 1)
+			r = -1;
+		break;
+	default:
+		r = -1;
+	}
+	free(str);
+	if (r < 0) {
+		free(pd.spec);
+		return r;
+	}
+	npd = realloc(p->pd, sizeof(*npd) * (p->npd + 1));
+	if (npd == NULL)
+		return -1;
+	p->pd = npd;
+	p->pd[p->npd++] = pd;
+	return 0;
+}
+
+/* draw the components of an irregular sea */
+static int
+spectrum_build(struct perturb_spectrum *sp)
+{
+	const int n = PERTURB_NCOMP;
+	double wp = 2 * M_PI / sp->tp;
+	double wlo = 0.5 * wp, dw = (3 * wp - wlo) / n;
+	double w, sigma, S, m0 = 0, b, phi, scale;
+	double *buf;
+	int i;
+
+	if ((buf = malloc(5 * n * sizeof(double))) == NULL)
+		return -1;
+	sp->re = buf;
+	sp->im = buf + n;
+	sp->rr = buf + 2 * n;
+	sp->ri = buf + 3 * n;
+	sp->g = buf + 4 * n;
+	for (i = 0; i < n; i++) {
+		w = wlo + (i + drandom()) * dw;
+		sigma = (w <= wp) ? 0.07 : 0.09;
+		S = pow(w, -5) * exp(-1.25 * pow(wp / w, 4)) *
+		    pow(sp->gamma, exp(-(w - wp) * (w - wp) /
+		    (2 * sigma * sigma * wp * wp)));
+		m0 += S * dw;
+		/* cos^2 directional spreading */
+		do {
+			b = (drandom() * 2 - 1) * M_PI / 2;
+		} while (drandom() > cos(b) * cos(b));
+		b += sp->dir * M_PI / 180;
+		phi = drandom() * 2 * M_PI;
+		sp->re[i] = cos(phi);
+		sp->im[i] = sin(phi);
+		sp->rr[i] = cos(w * PERTURB_DT);
+		sp->ri[i] = sin(w * PERTURB_DT);
+		/* slope amplitude k * a, k = w^2 / g in deep water */
+		sp->g[i] = w * w / 9.81 * sqrt(2 * S * dw) * sin(2 * b);
+	}
+	/* scale the spectrum to Hs = 4 * sqrt(m0) */
+	scale = (m0 > 0) ? sp->hs / (4 * sqrt(m0)) : 0;
+	for (i = 0; i < n; i++)
+		sp->g[i] *= scale;
+	sp->n = n;
+	return 0;
+}
+
+static double
+spectrum_step(struct perturb_spectrum *sp, double timediff)
+{
+	double * restrict re, * restrict im;
+	const double * restrict rr, * restrict ri, * restrict g;
+	double x, f, v = 0;
+	int i;
+
+	if (sp->n == 0 && spectrum_build(sp) < 0)
+		return 0;
+	re = sp->re;
+	im = sp->im;
+	rr = sp->rr;
+	ri = sp->ri;
+	g = sp->g;
+	if (timediff > 0)
+		sp->t += timediff;
+	/* the last 1ns is rounding */
+	while (sp->t >= PERTURB_DT - 1e-9) {
+		for (i = 0; i < sp->n; i++) {
+			x = re[i] * rr[i] - im[i] * ri[i];
+			im[i] = re[i] * ri[i] + im[i] * rr[i];
+			re[i] = x;
+		}
+		if (++sp->steps % 1024 == 0) {
+			/* keep the phasors on the unit circle */
+			for (i = 0; i < sp->n; i++) {
+				f = (3 - re[i] * re[i] - im[i] * im[i]) / 2;
+				re[i] *= f;
+				im[i] *= f;
+			}
+		}
+		sp->t -= PERTURB_DT;
+	}
+	for (i = 0; i < sp->n; i++)
+		v += g[i] * im[i];
+	return v;
+}
+
+/* advance all the waves by timediff seconds, and return their sum */
+double
+perturb_step(struct perturb *p, double timediff)
+{
+	struct perturb_descript *pd = p->pd;
+	double pert = 0;
+	double v;
+	int i;
+
+	for (i = 0; i < p->npd; i++) {
+		pd[i].time += timediff;
+		switch(pd[i].type) {
+		case t_sinus:
+			if (pd[i].time > pd[i].p0)
+				pd[i].time -= pd[i].p0;
+			v = pd[i].time / pd[i].p0 * 6.2831854;
+			pd[i].val = sin(v) * pd[i].a;
+			break;
+		case t_square:
+			if (pd[i].val == pd[i].a) {
+				if (pd[i].time > pd[i].p0) {
+					pd[i].time -= pd[i].p0;
+					pd[i].val = 0;
+				}
+			} else {
+				if (pd[i].time > pd[i].p1) {
+					pd[i].time -= pd[i].p1;
+					pd[i].val = pd[i].a;
+				}
+			}
+			break;
+		case t_random:
+			if (pd[i].time > pd[i].p1) {
+				pd[i].time -= pd[i].p1;
+				pd[i].p1 = pd[i].p0 * (drandom() + 0.5);
+				pd[i].val = pd[i].a * (drandom() * 2 - 1);
+			}
+			break;
+		case t_spectrum:
+			pd[i].val = spectrum_step(pd[i].spec, timediff);
+			break;
+		}
+		pert += pd[i].val;
+	}
+	return pert;
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2026 Manuel Bouyer
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *	notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *	notice, this list of conditions and the following disclaimer in the
+ *	documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE NETBSD FOUNDATION, INC. AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+ * TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE FOUNDATION OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef PERTURB_H_
+#define PERTURB_H_
+
+/*
+ * external perturbations (sea, wind) on a boat's heading, as a sum of
+ * periodic pseudo rudder angles: sinus (-s a:p), square (-q a:t1:t0)
+ * and random (-r a:t) waves, and irregular seas (-w Hs:Tp[:dir[:gamma]]).
+ */
+
+/*
+ * an irregular sea from a JONSWAP spectrum (Pierson-Moskowitz with
+ * gamma = 1): significant height Hs (m), peak period Tp (s), mean wave
+ * direction relative to the boat dir (degrees) and peak enhancement
+ * gamma. It's the sum of PERTURB_NCOMP components with random frequencies
+ * (one per frequency band), directions (cos^2 spreading) and phases,
+ * drawn from random() on the first step. Each component is a phasor
+ * rotated by a fixed angle every PERTURB_DT, so a step costs a few
+ * multiplications per component and no libm call.
+ * The yaw perturbation is the wave slope, weighted by sin(2 * direction)
+ * (the yaw moment is largest in quartering seas).
+ */
+#define PERTURB_NCOMP	256
+#define PERTURB_DT	0.01	/* s */
+
+struct perturb_spectrum {
+	double hs, tp, dir, gamma;
+	int n;		/* components, 0 until the first step */
+	long steps;
+	double t;	/* time not stepped yet */
+	double *re, *im; /* phasors */
+	double *rr, *ri; /* rotation per PERTURB_DT */
+	double *g;	/* slope gain */
+};
+
+struct perturb_descript
+{
+	enum type {
+		t_sinus,
+		t_square,
+		t_random,
+		t_spectrum
+	} type;
+	double a;
+	double p0, p1;
+	double time;
+	double val;
+	struct perturb_spectrum *spec;
+};
+
+struct perturb {
+	struct perturb_descript *pd;
+	int npd;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void perturb_init(struct perturb *);
+void perturb_free(struct perturb *);
+int perturb_add(struct perturb *, int, const char *);
+double perturb_step(struct perturb *, double);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif